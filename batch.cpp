@@ -0,0 +1,305 @@
+#include "batch.h"
+#include "boundedqueue.h"
+#include "rawimage.h"
+#include "settings.h"
+#include "taskpool.h"
+#include "trace.h"
+#include <QFile>
+#include <QImage>
+#include <QImageReader>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+
+void applyFilterStep(WorkImage &image, const FilterStep &step, FilterPrecision precision, const Execution &execution) {
+    if (step.filterType == FILTER_BLUR) {
+        blurImage(image, static_cast<int>(step.a), precision, execution);
+    } else if (step.filterType == FILTER_EDGE_DETECT) {
+        edgeDetectImage(image, step.a, precision, execution);
+    } else if (step.filterType == FILTER_SCALE) {
+        scaleImage(image, step.a, step.b, execution);
+    } else if (step.filterType == FILTER_MEDIAN) {
+        medianImage(image, static_cast<int>(step.a), execution);
+    } else if (step.filterType == FILTER_ROTATION) {
+        rotateImage(image, step.a, execution);
+    } else if (step.filterType == FILTER_CHROMATIC) {
+        shiftChannels(image, static_cast<int>(step.a), static_cast<int>(step.b), static_cast<int>(step.c), execution);
+    } else if (step.filterType == FILTER_MAPPING) {
+        toneMapImage(image, step.a, step.b != 0, execution);
+    }
+}
+
+/**
+ * @brief Admission control for the batch: a pixel budget for the images in
+ * flight, and the spare WorkImages they are filtered in, so their planes and
+ * scratch arenas are reused from one image to the next
+ */
+class BatchBudget {
+public:
+    explicit BatchBudget(std::int64_t limit) : m_limit(limit) {}
+
+    // What to reserve for an image of `pixels` pixels, -1 if its size is
+    // unknown. An unknown size counts as over budget: the image waits until
+    // nothing else is in flight and nothing is admitted next to it.
+    std::int64_t reservation(std::int64_t pixels) const {
+        return pixels >= 0 ? pixels : m_limit + 1;
+    }
+
+    void acquire(std::int64_t pixels) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_released.wait(lock, [&] { return m_inFlight == 0 || m_inFlight + pixels <= m_limit; });
+        m_inFlight += pixels;
+        m_peak = std::max(m_peak, m_inFlight);
+    }
+
+    void release(std::int64_t pixels, std::unique_ptr<WorkImage> work) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight -= pixels;
+            m_spare.push_back(std::move(work));
+        }
+        m_released.notify_all();
+    }
+
+    std::unique_ptr<WorkImage> takeWork() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_spare.empty()) {
+            return std::make_unique<WorkImage>();
+        }
+        std::unique_ptr<WorkImage> work = std::move(m_spare.back());
+        m_spare.pop_back();
+        return work;
+    }
+
+    std::int64_t peak() const { return m_peak; }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::int64_t m_limit;
+    std::int64_t m_inFlight = 0;
+    std::int64_t m_peak = 0;
+    std::vector<std::unique_ptr<WorkImage>> m_spare;
+};
+
+/**
+ * @brief An image on its way through the pipeline. `work` holds the pixels
+ * from decode to encode; `pixels` is its reservation in the budget and
+ * `inputPixels` its decoded size.
+ */
+struct BatchImage {
+    const BatchItem *item = nullptr;
+    std::int64_t pixels = 0;
+    std::int64_t inputPixels = 0;
+    std::unique_ptr<WorkImage> work;
+};
+
+/**
+ * @brief Busy time and item count of one stage, added to from its threads
+ */
+class StageTimer {
+public:
+    template <typename Body>
+    void time(Body &&body) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busySeconds += seconds;
+        m_items++;
+    }
+
+    StageStats stats(double wallSeconds, int threads) const {
+        StageStats stats;
+        stats.items = m_items;
+        stats.busySeconds = m_busySeconds;
+        stats.utilization = wallSeconds > 0 ? m_busySeconds / (wallSeconds * threads) : 0.0;
+        return stats;
+    }
+
+private:
+    std::mutex m_mutex;
+    double m_busySeconds = 0;
+    int m_items = 0;
+};
+
+/**
+ * @brief Reads item.input into work as interleaved RGBA, reusing the buffer
+ * work already holds
+ */
+static bool decodeImage(const BatchItem &item, WorkImage &work) {
+    TRACE_SPAN("batch.decode");
+    if (isRawImagePath(item.input.toStdString())) {
+        std::vector<RGBA> pixels;
+        int width, height;
+        work.release(pixels);
+        if (!loadRawImage(QFile::encodeName(item.input).toStdString(), pixels, width, height)) {
+            std::cout<<"Failed to load "<<item.input.toStdString()<<std::endl;
+            return false;
+        }
+        work.adopt(pixels, width, height);
+        return true;
+    }
+
+    QImage image;
+    if (!image.load(item.input)) {
+        std::cout<<"Failed to load "<<item.input.toStdString()<<std::endl;
+        return false;
+    }
+    image = image.convertToFormat(QImage::Format_RGBX8888);
+
+    // RGBX8888 stores bytes as R,G,B,X which is exactly the layout of RGBA
+    std::vector<RGBA> pixels;
+    work.release(pixels);
+    pixels.resize(static_cast<size_t>(image.width()) * image.height());
+    for (int row = 0; row < image.height(); row++) {
+        std::memcpy(pixels.data() + static_cast<size_t>(row) * image.width(), image.constScanLine(row), image.width() * sizeof(RGBA));
+    }
+    work.adopt(pixels, image.width(), image.height());
+    return true;
+}
+
+static void filterImage(WorkImage &work, const BatchOptions &options, const Execution &execution) {
+    TRACE_SPAN("batch.filter");
+    for (const FilterStep &step : options.steps) {
+        applyFilterStep(work, step, options.precision, execution);
+    }
+    work.convertTo(ImageLayout::Interleaved);
+}
+
+static bool encodeImage(const BatchItem &item, const WorkImage &work, const SaveOptions &save) {
+    TRACE_SPAN("batch.encode");
+    return saveImage(item.output, work.pixels.data(), work.width, work.height, save);
+}
+
+/**
+ * @brief Pixel count from the file header, -1 if it cannot be read
+ */
+static std::int64_t headerPixels(const QString &path) {
+    if (isRawImagePath(path.toStdString())) {
+        RawImageFile file;
+        return file.open(QFile::encodeName(path).toStdString()) ? static_cast<std::int64_t>(file.width()) * file.height() : -1;
+    }
+    QSize size = QImageReader(path).size();
+    return size.isValid() ? static_cast<std::int64_t>(size.width()) * size.height() : -1;
+}
+
+BatchStats runBatch(const std::vector<BatchItem> &items, const BatchOptions &options) {
+    TRACE_SPAN("batch");
+    auto start = std::chrono::steady_clock::now();
+    TaskPool pool(options.threads);
+    BatchBudget budget(options.concurrentImages ? options.maxPixelsInFlight : 0);
+    Execution execution{options.simd, options.tileTasks ? 0 : 1, nullptr, options.tileTasks ? &pool : nullptr};
+    int decodeThreads = std::max(1, options.decodeThreads);
+    int encodeThreads = std::max(1, options.encodeThreads);
+
+    BoundedQueue<BatchImage> decoded(options.queueCapacity);
+    BoundedQueue<BatchImage> filtered(options.queueCapacity);
+    StageTimer decodeTimer, filterTimer, encodeTimer;
+    std::atomic<int> failed{0};
+    std::atomic<std::int64_t> pixelsDone{0};
+
+    // A failed image leaves the pipeline where it failed
+    auto drop = [&](BatchImage &image) {
+        failed++;
+        budget.release(image.pixels, std::move(image.work));
+    };
+
+    std::atomic<size_t> nextItem{0};
+    std::vector<std::thread> decoders;
+    for (int t = 0; t < decodeThreads; t++) {
+        decoders.emplace_back([&] {
+            for (size_t i = nextItem++; i < items.size(); i = nextItem++) {
+                BatchImage image;
+                image.item = &items[i];
+                // Reading the header is enough to size the reservation
+                image.pixels = budget.reservation(headerPixels(items[i].input));
+                budget.acquire(image.pixels);
+                image.work = budget.takeWork();
+
+                bool ok = false;
+                decodeTimer.time([&] { ok = decodeImage(items[i], *image.work); });
+                if (ok) {
+                    image.inputPixels = static_cast<std::int64_t>(image.work->width) * image.work->height;
+                    decoded.push(std::move(image));
+                } else {
+                    drop(image);
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> encoders;
+    for (int t = 0; t < encodeThreads; t++) {
+        encoders.emplace_back([&] {
+            BatchImage image;
+            while (filtered.pop(image)) {
+                bool ok = false;
+                encodeTimer.time([&] { ok = encodeImage(*image.item, *image.work, options.save); });
+                if (ok) {
+                    pixelsDone += image.inputPixels;
+                    budget.release(image.pixels, std::move(image.work));
+                } else {
+                    drop(image);
+                }
+            }
+        });
+    }
+
+    // Closes the decode queue once every decoder is done
+    std::thread closer([&] {
+        for (std::thread &decoder : decoders) {
+            decoder.join();
+        }
+        decoded.close();
+    });
+
+    // The filter stage: this thread hands each decoded image to the pool,
+    // one per pool thread at most. It takes the next image only once a slot
+    // is free, so the rest wait in the decode queue and a full queue stalls
+    // decode.
+    TaskPool::Group group;
+    std::counting_semaphore<> filterSlots(pool.threadCount());
+    BatchImage next;
+    for (filterSlots.acquire(); decoded.pop(next); filterSlots.acquire()) {
+        auto image = std::make_shared<BatchImage>(std::move(next));
+        pool.run(group, [&, image] {
+            filterTimer.time([&] { filterImage(*image->work, options, execution); });
+            filtered.push(std::move(*image));
+            filterSlots.release();
+        });
+    }
+    pool.wait(group);
+    closer.join();
+    filtered.close();
+    for (std::thread &encoder : encoders) {
+        encoder.join();
+    }
+
+    BatchStats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.images = static_cast<int>(items.size());
+    stats.failed = failed;
+    stats.pixels = pixelsDone;
+    stats.peakPixelsInFlight = budget.peak();
+    stats.tasks = pool.tasksRun();
+    stats.steals = pool.steals();
+
+    stats.decode = decodeTimer.stats(stats.seconds, decodeThreads);
+    // Tiles run on every pool thread, so the pool's own busy time is used
+    stats.filter = filterTimer.stats(stats.seconds, pool.threadCount());
+    stats.filter.busySeconds = pool.busySeconds();
+    stats.filter.utilization = pool.busySeconds() / (stats.seconds * pool.threadCount());
+    stats.filter.maxQueueDepth = decoded.maxDepth();
+    stats.filter.meanQueueDepth = decoded.meanDepth();
+    stats.encode = encodeTimer.stats(stats.seconds, encodeThreads);
+    stats.encode.maxQueueDepth = filtered.maxDepth();
+    stats.encode.meanQueueDepth = filtered.meanDepth();
+    return stats;
+}
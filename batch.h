@@ -0,0 +1,83 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QString>
+#include <cstdint>
+#include <vector>
+#include "imagefilters.h"
+#include "imagesave.h"
+
+// One filter of a chain, as applied by the batch runner and the golden-image
+// fixtures
+struct FilterStep {
+    int filterType;  // @see FilterType
+    float a;         // blur or median radius, edge sensitivity, x scale, gamma,
+                     // red shift or rotation angle
+    float b;         // y scale, green shift, or 1 for non-linear tone mapping
+    float c = 0;     // blue shift
+};
+
+void applyFilterStep(WorkImage &image, const FilterStep &step, FilterPrecision precision, const Execution &execution);
+
+struct BatchItem {
+    QString input;
+    QString output;  // format from the suffix unless BatchOptions::save sets one
+};
+
+struct BatchOptions {
+    std::vector<FilterStep> steps;
+    FilterPrecision precision = FilterPrecision::FixedPoint;
+    bool simd = true;
+    int threads = 0;                // pool threads, 0 = one per core
+    bool concurrentImages = true;   // false: one image at a time
+    bool tileTasks = true;          // false: every image is filtered on one thread
+    int decodeThreads = 1;
+    int encodeThreads = 1;
+    int queueCapacity = 2;          // images waiting between two stages
+    // Back-pressure: images are only decoded while the images between
+    // decode and finished encode hold fewer pixels than this (counted at
+    // their input size). One image is always let through; an image whose
+    // header cannot be read counts as over budget and goes through alone.
+    std::int64_t maxPixelsInFlight = 64LL << 20;
+    SaveOptions save = fastSaveOptions();
+};
+
+struct StageStats {
+    int items = 0;
+    double busySeconds = 0;         // summed over the stage's threads
+    // busySeconds / (wall time * threads). Busy time is wall clock, so this
+    // can exceed 1 when the stages have more threads than there are cores.
+    double utilization = 0;
+    int maxQueueDepth = 0;          // images waiting in the stage's input queue
+    double meanQueueDepth = 0;      // averaged over time
+};
+
+struct BatchStats {
+    int images = 0;
+    int failed = 0;
+    std::int64_t pixels = 0;        // input pixels of the images processed
+    double seconds = 0;
+    std::int64_t peakPixelsInFlight = 0;
+    std::uint64_t tasks = 0;
+    std::uint64_t steals = 0;
+    // Decode has no input queue; its depth fields stay 0
+    StageStats decode;
+    StageStats filter;
+    StageStats encode;
+};
+
+/**
+ * Runs every item through a three-stage pipeline:
+ *
+ *     decode threads -> queue -> filter (TaskPool) -> queue -> encode threads
+ *
+ * so one image decodes while the previous one is filtered and the one before
+ * that is encoded. Each decoded image is a pool task, at most one per pool
+ * thread at a time; with tileTasks its filter passes are split into row
+ * tiles queued on the same pool, so idle threads steal tiles of big images
+ * while small ones finish. Full queues stall the stage before them. Failures are reported on stdout and counted;
+ * the rest of the batch carries on.
+ */
+BatchStats runBatch(const std::vector<BatchItem> &items, const BatchOptions &options);
+
+#endif // BATCH_H
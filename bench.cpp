@@ -0,0 +1,1086 @@
+/**
+ * @file    bench.cpp
+ *
+ * Headless benchmarks for the raster kernels: convolution filters, scaling,
+ * rotation, the median, channel shifts, point ops, image statistics, brush
+ * stamps, stroke replay, mip pyramid updates, image load/save, encoder
+ * settings and canvas display. Every measurement is printed as one JSON
+ * object per line so runs can be collected and compared.
+ *
+ * Usage: projects_raster_bench [--images DIR] [--sizes WxH,WxH,...]
+ *                              [--reps N] [--filter TEXT]
+ *        projects_raster_bench --verify [--golden DIR] [--images DIR]
+ *        projects_raster_bench --batch [--images DIR] [--reps N]
+ *        projects_raster_bench --replay FILE [--reps N]
+ *
+ *  --images   directory of input images (default: fun_images/), "" to skip
+ *  --sizes    synthetic image sizes (default: 640x480,1920x1080,4000x3000)
+ *  --reps     timed repetitions per measurement, best and median reported
+ *  --filter   only run benchmarks whose name contains TEXT
+ *  --verify   replay the golden-image fixtures on every backend, check the
+ *             median against a brute-force one and the SIMD point-op
+ *             lookups against scalar ones instead of benchmarking; exits
+ *             with 1 if any comparison fails
+ *  --golden   directory of golden PNGs (default: golden_outputs/)
+ *  --batch    run the batch scheduler over the inputs at several scales,
+ *             one image at a time, one thread per image, and as tile tasks,
+ *             plus tile tasks with Qt's default encoder settings
+ *  --replay   replay a stroke recording saved from the app ("Record
+ *             strokes") and report stamps/s, pixels written and whether the
+ *             final checksum matches the recorded one; exits with 1 if not
+ *  --trace    record tracing spans and write them to FILE as a Chrome trace
+ */
+
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QTemporaryDir>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "brushengine.h"
+#include "canvas2d.h"
+#include "imagecompare.h"
+#include "imagefilters.h"
+#include "imagesave.h"
+#include "imagestats.h"
+#include "mippyramid.h"
+#include "rawimage.h"
+#include "settings.h"
+#include "strokes.h"
+#include "trace.h"
+
+// ------ ALLOCATION COUNTING ------
+
+static std::atomic<size_t> g_allocCount{0};
+static std::atomic<size_t> g_allocBytes{0};
+
+void *operator new(size_t size) {
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    g_allocBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+// ScratchArena blocks come through here
+void *operator new(size_t size, std::align_val_t alignment) {
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    g_allocBytes.fetch_add(size, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void *p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+// Minor page faults of the whole process so far; new heap pages show up here
+// on first touch
+static long minorPageFaults() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+// ------ MEASUREMENT ------
+
+struct Input {
+    std::string name;
+    int width = 0;
+    int height = 0;
+    std::vector<RGBA> pixels;
+};
+
+struct Options {
+    QString imageDir = QString(RASTER_SOURCE_DIR) + "/fun_images";
+    QString goldenDir = QString(RASTER_SOURCE_DIR) + "/golden_outputs";
+    bool verify = false;
+    bool batch = false;
+    QString replayFile;
+    QString traceFile;
+    std::vector<std::pair<int, int>> sizes = {{640, 480}, {1920, 1080}, {4000, 3000}};
+    int reps = 5;
+    std::string filter;
+};
+
+static Options g_options;
+
+static bool selected(const std::string &bench) {
+    return g_options.filter.empty() || bench.find(g_options.filter) != std::string::npos;
+}
+
+/**
+ * @brief Times `run` g_options.reps times, calling the untimed `setup` before
+ * each repetition, and prints one JSON line.
+ * @param pixels: pixels processed by one call of `run`, for MP/s and ns/pixel
+ */
+static void measure(const std::string &bench, const std::string &param, const Input &input, double pixels,
+                    const std::function<void()> &setup, const std::function<void()> &run) {
+    std::vector<double> times;
+    size_t allocs = 0;
+    size_t allocBytes = 0;
+    long pageFaults = 0;
+    for (int rep = 0; rep < g_options.reps; rep++) {
+        setup();
+        size_t countBefore = g_allocCount.load();
+        size_t bytesBefore = g_allocBytes.load();
+        long faultsBefore = minorPageFaults();
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        allocs = g_allocCount.load() - countBefore;
+        allocBytes = g_allocBytes.load() - bytesBefore;
+        pageFaults = minorPageFaults() - faultsBefore;
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    double best = times.front();
+    double median = times[times.size() / 2];
+
+    std::printf("{\"bench\":\"%s\",\"param\":\"%s\",\"input\":\"%s\",\"width\":%d,\"height\":%d,"
+                "\"reps\":%d,\"ms_min\":%.4f,\"ms_median\":%.4f,\"mp_per_s\":%.3f,\"ns_per_pixel\":%.3f,"
+                "\"allocs\":%zu,\"alloc_bytes\":%zu,\"page_faults\":%ld}\n",
+                bench.c_str(), param.c_str(), input.name.c_str(), input.width, input.height,
+                g_options.reps, best, median, pixels / (best * 1e3), best * 1e6 / pixels,
+                allocs, allocBytes, pageFaults);
+    std::fflush(stdout);
+}
+
+// ------ INPUTS ------
+
+/**
+ * @brief Smooth gradients plus noise, so neither the filters nor the PNG
+ * encoder see a degenerate image
+ */
+static Input syntheticInput(int width, int height) {
+    Input input;
+    input.name = "synthetic";
+    input.width = width;
+    input.height = height;
+    input.pixels.resize(static_cast<size_t>(width) * height);
+    std::mt19937 rng(width * 31 + height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int noise = rng() % 32;
+            input.pixels[static_cast<size_t>(y) * width + x] =
+                RGBA{static_cast<std::uint8_t>((x * 255 / width + noise) & 255),
+                     static_cast<std::uint8_t>((y * 255 / height + noise) & 255),
+                     static_cast<std::uint8_t>(((x + y) & 255) ^ noise), 255};
+        }
+    }
+    return input;
+}
+
+// One color everywhere, where any error in the kernel's normalization shows
+static Input flatInput(int width, int height, std::uint8_t value) {
+    Input input;
+    input.name = "flat";
+    input.width = width;
+    input.height = height;
+    input.pixels.assign(static_cast<size_t>(width) * height, RGBA{value, value, value, 255});
+    return input;
+}
+
+static bool fileInput(const QString &path, Input &input) {
+    QImage image;
+    if (!image.load(path)) {
+        return false;
+    }
+    image = image.convertToFormat(QImage::Format_RGBX8888);
+    input.name = QFileInfo(path).fileName().toStdString();
+    input.width = image.width();
+    input.height = image.height();
+    input.pixels.resize(static_cast<size_t>(input.width) * input.height);
+    for (int row = 0; row < input.height; row++) {
+        std::memcpy(input.pixels.data() + static_cast<size_t>(row) * input.width, image.constScanLine(row), input.width * sizeof(RGBA));
+    }
+    return true;
+}
+
+// ------ BENCHMARKS ------
+
+/**
+ * Execution backends, benchmarked side by side and replayed for every golden
+ * fixture. The float backends must match the golden images exactly, fixed
+ * point within the fixture's fixedTolerance.
+ */
+struct Backend {
+    const char *name;
+    FilterPrecision precision;
+    Execution execution;
+};
+
+static const Backend kBackends[] = {
+    {"serial",   FilterPrecision::Float,      {false, 1}},
+    {"threaded", FilterPrecision::Float,      {false, 0}},
+    {"simd",     FilterPrecision::Float,      {true, 1}},
+    {"fixed",    FilterPrecision::FixedPoint, {true, 0}},
+};
+
+static void benchFilters(const Input &input) {
+    double pixels = static_cast<double>(input.width) * input.height;
+    WorkImage image;
+    std::vector<RGBA> scratch;
+    auto reset = [&] {
+        scratch = input.pixels;
+        image.adopt(scratch, input.width, input.height);
+    };
+
+    for (const Backend &backend : kBackends) {
+        std::string name = backend.name;
+        if (selected("blur")) {
+            for (int radius : {1, 2, 5, 10, 25}) {
+                measure("blur", "r=" + std::to_string(radius) + " " + name, input, pixels,
+                        reset, [&] { blurImage(image, radius, backend.precision, backend.execution); });
+            }
+        }
+        if (selected("edge")) {
+            measure("edge", "s=0.5 " + name, input, pixels,
+                    reset, [&] { edgeDetectImage(image, 0.5f, backend.precision, backend.execution); });
+        }
+        // Scaling and the median have no fixed-point or SIMD path
+        if (selected("scale") && !backend.execution.simd) {
+            measure("scale", "down 0.5x0.5 " + name, input, pixels, reset, [&] { scaleImage(image, 0.5f, 0.5f, backend.execution); });
+            measure("scale", "up 1.5x1.5 " + name, input, pixels, reset, [&] { scaleImage(image, 1.5f, 1.5f, backend.execution); });
+        }
+        // Rotation has no fixed-point path; MP/s count source pixels
+        if (selected("rotate") && backend.precision == FilterPrecision::Float) {
+            for (float angle : {90.0f, 180.0f, 0.5f, 30.0f, 45.0f}) {
+                char param[32];
+                std::snprintf(param, sizeof(param), "%g deg ", angle);
+                measure("rotate", param + name, input, pixels, reset, [&] { rotateImage(image, angle, backend.execution); });
+            }
+        }
+        if (selected("median") && !backend.execution.simd) {
+            for (int radius : {1, 3, 10}) {
+                measure("median", "r=" + std::to_string(radius) + " " + name, input, pixels,
+                        reset, [&] { medianImage(image, radius, backend.execution); });
+            }
+        }
+    }
+}
+
+/**
+ * @brief A gamma, levels and curve chain folded into the conversion to
+ * planar ("fused"), against the plain conversion and against one in-place
+ * pass per op followed by the conversion ("passes"). Also the folded chain
+ * applied to planes with scalar and SIMD lookups ("lut"), tone mapping and
+ * the gray conversion edge detection starts with.
+ */
+static void benchPointOps(const Input &input) {
+    if (!selected("point")) {
+        return;
+    }
+    double pixels = static_cast<double>(input.width) * input.height;
+    WorkImage image;
+    std::vector<RGBA> scratch;
+    auto reset = [&] {
+        scratch = input.pixels;
+        image.adopt(scratch, input.width, input.height);
+    };
+    const PointOp chain[] = {PointOp::gamma(0.8f), PointOp::levels(10, 240), PointOp::curve({{0, 0}, {128, 150}, {255, 255}})};
+
+    measure("point", "convert", input, pixels, reset, [&] { image.convertTo(ImageLayout::Planar8); });
+    measure("point", "fused x3", input, pixels, reset, [&] {
+        for (const PointOp &op : chain) {
+            applyPointOp(image, op);
+        }
+        image.convertTo(ImageLayout::Planar8);
+    });
+    measure("point", "passes x3", input, pixels, reset, [&] {
+        for (const PointOp &op : chain) {
+            op.apply(image.pixels.data(), image.size(), image.pixels.data());
+        }
+        image.convertTo(ImageLayout::Planar8);
+    });
+    PointOp folded;
+    for (const PointOp &op : chain) {
+        folded.append(op);
+    }
+    for (bool simd : {false, true}) {
+        auto toPlanes = [&] {
+            reset();
+            image.convertTo(ImageLayout::Planar8);
+        };
+        measure("point", simd ? "lut simd" : "lut scalar", input, pixels, toPlanes, [&] {
+            std::uint8_t *planes[3] = {image.planes8[0].data(), image.planes8[1].data(), image.planes8[2].data()};
+            folded.apply(planes[0], planes[1], planes[2], image.size(), planes[0], planes[1], planes[2], simd);
+        });
+    }
+    measure("point", "gray fused", input, pixels, reset, [&] {
+        applyPointOp(image, PointOp::gray());
+        image.convertTo(ImageLayout::Planar8);
+    });
+    measure("point", "tonemap linear", input, pixels, reset, [&] {
+        toneMapImage(image, 1, false);
+        image.convertTo(ImageLayout::Interleaved);
+    });
+}
+
+/**
+ * @brief The channel shift on planes, serial and on every core, against
+ * memcpy of the same three planes as the bandwidth it should reach, and on
+ * interleaved pixels, as the canvas and batch hold them, against the planar
+ * round trip ("convert") that the interleaved path saves. The shift works in
+ * place in either layout, so repetitions need no reset.
+ */
+static void benchChromatic(const Input &input) {
+    if (!selected("chromatic")) {
+        return;
+    }
+    double pixels = static_cast<double>(input.width) * input.height;
+    WorkImage image;
+    std::vector<RGBA> scratch = input.pixels;
+    image.adopt(scratch, input.width, input.height);
+    image.convertTo(ImageLayout::Planar8);
+    std::vector<std::uint8_t> copies[3];
+    auto none = [] {};
+
+    measure("chromatic", "memcpy", input, pixels, [&] {
+        for (std::vector<std::uint8_t> &copy : copies) {
+            copy.resize(image.size());
+        }
+    }, [&] {
+        for (int c = 0; c < 3; c++) {
+            std::memcpy(copies[c].data(), image.planes8[c].data(), image.size());
+        }
+    });
+    for (int threads : {1, 0}) {
+        Execution execution{true, threads};
+        std::string name = threads == 1 ? " serial" : " threaded";
+        measure("chromatic", "r=-4 g=0 b=4 planar" + name, input, pixels, none, [&] { shiftChannels(image, -4, 0, 4, execution); });
+    }
+
+    WorkImage full;
+    std::vector<RGBA> fullPixels;
+    auto reset = [&] {
+        fullPixels = input.pixels;
+        full.adopt(fullPixels, input.width, input.height);
+    };
+    measure("chromatic", "convert", input, pixels, reset, [&] {
+        full.convertTo(ImageLayout::Planar8);
+        full.convertTo(ImageLayout::Interleaved);
+    });
+    reset();
+    for (int threads : {1, 0}) {
+        Execution execution{true, threads};
+        std::string name = threads == 1 ? " serial" : " threaded";
+        measure("chromatic", "r=-4 g=0 b=4 interleaved" + name, input, pixels, none, [&] { shiftChannels(full, -4, 0, 4, execution); });
+    }
+}
+
+/**
+ * @brief Histograms of all channels: straight from interleaved pixels
+ * against one shared set of bins ("single bins"), from planes, and through
+ * a pending gamma, serial and on every core
+ */
+static void benchStats(const Input &input) {
+    if (!selected("stats")) {
+        return;
+    }
+    double pixels = static_cast<double>(input.width) * input.height;
+    WorkImage image;
+    std::vector<RGBA> scratch = input.pixels;
+    image.adopt(scratch, input.width, input.height);
+    auto none = [] {};
+    ImageStats stats;
+
+    measure("stats", "single bins", input, pixels, none, [&] {
+        stats = ImageStats();
+        for (const RGBA &pixel : image.pixels) {
+            stats.channels[0].histogram[pixel.r]++;
+            stats.channels[1].histogram[pixel.g]++;
+            stats.channels[2].histogram[pixel.b]++;
+            stats.channels[3].histogram[pixel.a]++;
+        }
+    });
+    for (int threads : {1, 0}) {
+        Execution execution{true, threads};
+        std::string name = threads == 1 ? " serial" : " threaded";
+        measure("stats", "interleaved" + name, input, pixels, none, [&] { stats = computeImageStats(image, execution); });
+        applyPointOp(image, PointOp::gamma(0.8f));
+        measure("stats", "pending gamma" + name, input, pixels, none, [&] { stats = computeImageStats(image, execution); });
+        image.convertTo(ImageLayout::Planar8);
+        measure("stats", "planar8" + name, input, pixels, none, [&] { stats = computeImageStats(image, execution); });
+        image.convertTo(ImageLayout::Interleaved);
+    }
+}
+
+/**
+ * @brief Stamps a fixed zig-zag stroke of 1000 dabs, with the legacy sRGB
+ * blend and again with linear blending ("... linear"). Pixels are counted as
+ * brush mask pixels written, not canvas pixels; stamps per second is
+ * 1000 / ms_min * 1000.
+ */
+static void benchBrushes(const Input &input) {
+    if (!selected("brush")) {
+        return;
+    }
+    const int stamps = 1000;
+    std::vector<RGBA> canvas;
+    BrushEngine brush;
+
+    for (int radius : {5, 20, 50}) {
+        double pixels = static_cast<double>(stamps) * (2 * radius + 1) * (2 * radius + 1);
+        auto stroke = [&](auto &&dab) {
+            for (int i = 0; i < stamps; i++) {
+                int x = (i * 7) % input.width;
+                int y = (i * 13) % input.height;
+                dab(x, y);
+            }
+        };
+        auto reset = [&] { canvas = input.pixels; };
+        std::string r = "r=" + std::to_string(radius);
+        RGBA color{200, 40, 90, 180};
+
+        for (bool linear : {false, true}) {
+            std::string blend = linear ? " linear" : "";
+            brush.setLinearBlending(linear);
+            brush.initConstantMask(radius);
+            measure("brush", "constant " + r + blend, input, pixels, reset,
+                    [&] { stroke([&](int x, int y) { brush.stamp(canvas, input.width, input.height, x, y, color); }); });
+            brush.initLinearMask(radius);
+            measure("brush", "linear " + r + blend, input, pixels, reset,
+                    [&] { stroke([&](int x, int y) { brush.stamp(canvas, input.width, input.height, x, y, color); }); });
+            brush.initQuadraticMask(radius);
+            measure("brush", "quadratic " + r + blend, input, pixels, reset,
+                    [&] { stroke([&](int x, int y) { brush.stamp(canvas, input.width, input.height, x, y, color); }); });
+            brush.initLinearMask(radius);
+            measure("brush", "smudge " + r + blend, input, pixels, reset, [&] {
+                brush.pickUp(canvas, input.width, input.height, 0, 0);
+                stroke([&](int x, int y) {
+                    brush.smudge(canvas, input.width, input.height, x, y);
+                    brush.pickUp(canvas, input.width, input.height, x, y);
+                });
+            });
+        }
+    }
+}
+
+/**
+ * @brief Replays a generated recording, one 250-dab zig-zag stroke per
+ * brush type at r=20, after a round trip through the recording file. Pixels
+ * are canvas pixels under the dabs, as in ReplayResult.
+ */
+static void benchReplay(const Input &input, const QTemporaryDir &tempDir) {
+    if (!selected("replay")) {
+        return;
+    }
+    const int dabs = 250;
+    StrokeRecording recording;
+    recording.width = input.width;
+    recording.height = input.height;
+    recording.base = input.pixels;
+    for (int type : {BRUSH_CONSTANT, BRUSH_LINEAR, BRUSH_QUADRATIC, BRUSH_SMUDGE}) {
+        Stroke stroke;
+        stroke.brush = {type, 20, RGBA{200, 40, 90, 180}, true};
+        for (int i = 0; i < dabs; i++) {
+            int t = static_cast<int>(recording.strokes.size()) * dabs + i;
+            stroke.points.push_back({t * 4000ll, (t * 7) % input.width, (t * 13) % input.height});
+        }
+        recording.strokes.push_back(stroke);
+    }
+    std::vector<RGBA> canvas;
+    recording.checksum = replayStrokes(recording, canvas).checksum;
+
+    std::string path = tempDir.filePath("replay.strokes").toStdString();
+    StrokeRecording loaded;
+    if (!saveStrokeRecording(path, recording) || !loadStrokeRecording(path, loaded)) {
+        return;
+    }
+    ReplayResult result;
+    measure("replay", "4 strokes r=20", input, static_cast<double>(replayStrokes(loaded, canvas).pixelsWritten), [] {},
+            [&] { result = replayStrokes(loaded, canvas); });
+    if (result.checksum != recording.checksum) {
+        std::printf("{\"bench\":\"replay\",\"error\":\"checksum mismatch after save and load\"}\n");
+    }
+}
+
+/**
+ * @brief Building the mip pyramid from scratch, and bringing it up to date
+ * after the brush has touched one tile per stamp
+ */
+static void benchPyramid(const Input &input) {
+    if (!selected("mip")) {
+        return;
+    }
+    double pixels = static_cast<double>(input.width) * input.height;
+    MipPyramid pyramid;
+    measure("mip", "build", input, pixels, [&] { pyramid.reset(input.width, input.height); },
+            [&] { pyramid.update(input.pixels.data()); });
+
+    const int stamps = 100;
+    const int radius = 20;
+    measure("mip", "stamps r=20", input, static_cast<double>(stamps) * (2 * radius + 1) * (2 * radius + 1), [] {}, [&] {
+        for (int i = 0; i < stamps; i++) {
+            int x = (i * 7) % input.width;
+            int y = (i * 13) % input.height;
+            pyramid.invalidate(x - radius, y - radius, 2 * radius + 1, 2 * radius + 1);
+            pyramid.update(input.pixels.data());
+        }
+    });
+}
+
+// One JSON line with the size of a file written by a benchmark
+static void printFileSize(const char *bench, const std::string &param, const Input &input, const QString &file) {
+    std::printf("{\"bench\":\"%s\",\"param\":\"%s\",\"input\":\"%s\",\"width\":%d,\"height\":%d,\"bytes\":%lld}\n",
+                bench, param.c_str(), input.name.c_str(), input.width, input.height,
+                static_cast<long long>(QFileInfo(file).size()));
+    std::fflush(stdout);
+}
+
+/**
+ * @brief Encode time against file size: PNG at zlib levels 0 to 9 and JPEG
+ * at several qualities, plus Qt's defaults and the batch profile. Sizes are
+ * printed as "encode_size" lines with the same param, and the decoded file
+ * against the input as "encode_roundtrip" lines (max_diff 0 for PNG).
+ */
+static void benchEncode(const Input &input, const QTemporaryDir &tempDir) {
+    if (!selected("encode")) {
+        return;
+    }
+    double pixels = static_cast<double>(input.width) * input.height;
+    struct Setting {
+        std::string name;
+        SaveOptions options;
+    };
+    std::vector<Setting> cases = {{"png-default", {"png"}}, {"jpg-default", {"jpg"}}};
+    for (int level : {0, 1, 3, 6, 9}) {
+        cases.push_back({"png-" + std::to_string(level), {"png", level}});
+    }
+    for (int quality : {50, 75, 90, 100}) {
+        cases.push_back({"jpg-q" + std::to_string(quality), {"jpg", -1, quality}});
+    }
+    SaveOptions fast = fastSaveOptions();
+    fast.format = "png";
+    cases.push_back({"png-fast", fast});
+    fast.format = "jpg";
+    cases.push_back({"jpg-fast", fast});
+
+    auto none = [] {};
+    for (const Setting &setting : cases) {
+        QString path = tempDir.filePath(QString::fromStdString("encode_" + setting.name + ".") + QString::fromLatin1(setting.options.format));
+        measure("encode", setting.name, input, pixels, none, [&] {
+            saveImage(path, input.pixels.data(), input.width, input.height, setting.options);
+        });
+        printFileSize("encode_size", setting.name, input, path);
+
+        // The pixels are saved straight from the input's memory; PNG must
+        // decode back to them exactly
+        Input decoded;
+        if (fileInput(path, decoded)) {
+            ImageDifference diff = compareImages(decoded.pixels, decoded.width, decoded.height,
+                                                 input.pixels, input.width, input.height);
+            char psnr[32] = "null";
+            if (std::isfinite(diff.psnr)) {
+                std::snprintf(psnr, sizeof(psnr), "%.2f", diff.psnr);
+            }
+            std::printf("{\"bench\":\"encode_roundtrip\",\"param\":\"%s\",\"input\":\"%s\",\"width\":%d,\"height\":%d,"
+                        "\"same_size\":%s,\"max_diff\":%d,\"psnr\":%s}\n",
+                        setting.name.c_str(), input.name.c_str(), input.width, input.height,
+                        diff.sameSize ? "true" : "false", diff.maxChannelDiff(), psnr);
+        }
+    }
+}
+
+/**
+ * @brief PNG and .rimg save and load through Canvas2D, plus displayImage(),
+ * which now only resets the pyramid and resizes the widget. File sizes are
+ * printed as separate "file_size" lines.
+ */
+static void benchCanvas(const Input &input, Canvas2D &canvas, const QTemporaryDir &tempDir) {
+    double pixels = static_cast<double>(input.width) * input.height;
+    QString path = tempDir.filePath(QString::fromStdString(input.name) + QString("_%1x%2.png").arg(input.width).arg(input.height));
+    QString rawPath = path.left(path.size() - 3) + kRawImageSuffix;
+
+    // Saving goes through the canvas, so put the input on it first
+    QImage image(reinterpret_cast<const uchar*>(input.pixels.data()), input.width, input.height, QImage::Format_RGBX8888);
+    image.save(path);
+    canvas.loadImageFromFile(path);
+
+    auto none = [] {};
+    if (selected("save")) {
+        measure("save", "png", input, pixels, none, [&] { canvas.saveImageToFile(path); });
+        measure("save", "rimg", input, pixels, none, [&] { canvas.saveImageToFile(rawPath); });
+        printFileSize("file_size", QFileInfo(path).suffix().toStdString(), input, path);
+        printFileSize("file_size", kRawImageSuffix, input, rawPath);
+    }
+    if (selected("load")) {
+        measure("load", "png", input, pixels, none, [&] { canvas.loadImageFromFile(path); });
+        if (QFileInfo::exists(rawPath)) {
+            measure("load", "rimg", input, pixels, none, [&] { canvas.loadImageFromFile(rawPath); });
+        }
+    }
+    if (selected("display")) {
+        measure("display", "reset", input, pixels, none, [&] { canvas.displayImage(); });
+    }
+}
+
+static void runAll(const Input &input, Canvas2D &canvas, const QTemporaryDir &tempDir) {
+    benchFilters(input);
+    benchPointOps(input);
+    benchChromatic(input);
+    benchStats(input);
+    if (input.name == "synthetic") {
+        benchBrushes(input);
+        benchReplay(input, tempDir);
+    }
+    benchPyramid(input);
+    benchEncode(input, tempDir);
+    benchCanvas(input, canvas, tempDir);
+}
+
+// ------ GOLDEN IMAGES ------
+
+/**
+ * A golden image and how it was made from a fun_images/ input.
+ *
+ * golden_outputs/ was rendered by the original Canvas2D filters, serial and
+ * without fused multiply-adds (the kernels are built with -ffp-contract=off
+ * for the same reason), so any difference on a float backend is a change in
+ * behavior. expected_outputs/ is the course's reference and can be passed
+ * with --golden, but the original filters already differ from it by up to
+ * 245 levels on the blur and edge fixtures.
+ *
+ * `input` names a file in the image directory, or "flat:WxH:V" for a flat
+ * image of gray level V. On flat fields the float kernel, which sums to just
+ * under 1 in single precision, loses a level per truncated pass that the
+ * fixed-point kernel keeps, so those fixtures allow the fixed backend two.
+ */
+struct Fixture {
+    const char *name;
+    const char *input;
+    std::vector<FilterStep> steps;
+    int fixedTolerance = 1;    // largest channel difference allowed on the fixed backend
+};
+
+static const std::vector<Fixture> kFixtures = {
+    {"grid_blur_0",   "grid.jpeg",        {{FILTER_BLUR, 0, 0}}},
+    {"grid_blur_2",   "grid.jpeg",        {{FILTER_BLUR, 2, 0}, {FILTER_BLUR, 2, 0}, {FILTER_BLUR, 2, 0}}},
+    {"edge_blur_10",  "edge.png",         {{FILTER_BLUR, 10, 0}}},
+    {"edge_edge_1",   "edge.png",         {{FILTER_EDGE_DETECT, 0.2f, 0}}},
+    {"edge_edge_2",   "edge.png",         {{FILTER_EDGE_DETECT, 0.5f, 0}, {FILTER_EDGE_DETECT, 0.5f, 0}, {FILTER_EDGE_DETECT, 0.5f, 0}}},
+    {"mona_lisa_1",   "mona_lisa.jpg",    {{FILTER_SCALE, 0.2f, 1.0f}}},
+    {"mona_lisa_2",   "mona_lisa.jpg",    {{FILTER_SCALE, 1.0f, 0.2f}}},
+    {"mona_lisa_3",   "mona_lisa.jpg",    {{FILTER_SCALE, 0.2f, 0.2f}}},
+    {"amongus",       "amongus.jpg",      {{FILTER_SCALE, 0.2f, 0.2f}, {FILTER_SCALE, 5.0f, 5.0f}}},
+    {"andy_1",        "andy.jpeg",        {{FILTER_SCALE, 1.4f, 1.0f}}},
+    {"andy_2",        "andy.jpeg",        {{FILTER_SCALE, 1.0f, 1.4f}}},
+    {"grid_blur_40",  "grid.jpeg",        {{FILTER_BLUR, 40, 0}}},
+    {"edge_blur_100", "edge.png",         {{FILTER_BLUR, 100, 0}}},
+    {"flat_blur_7",   "flat:400x300:255", {{FILTER_BLUR, 7, 0}}},
+    {"flat_blur_8",   "flat:400x300:255", {{FILTER_BLUR, 8, 0}}, 2},
+    {"flat_blur_100", "flat:400x300:255", {{FILTER_BLUR, 100, 0}}, 2},
+    {"gray_blur_12",  "flat:400x300:128", {{FILTER_BLUR, 12, 0}}, 2},
+    {"pixel_blur_40", "flat:1x1:255",     {{FILTER_BLUR, 40, 0}}, 2},
+};
+
+// Loads a fixture's input; see Fixture
+static bool fixtureInput(const char *name, Input &input) {
+    int width = 0;
+    int height = 0;
+    int value = 0;
+    if (std::sscanf(name, "flat:%dx%d:%d", &width, &height, &value) == 3) {
+        input = flatInput(width, height, static_cast<std::uint8_t>(value));
+        return true;
+    }
+    return fileInput(QDir(g_options.imageDir).filePath(name), input);
+}
+
+/**
+ * @brief Runs every fixture on every backend and prints one JSON line per
+ * comparison
+ * @return true if all comparisons passed
+ */
+static bool verifyFixtures() {
+    bool allPassed = true;
+    QDir goldens(g_options.goldenDir);
+
+    for (const Fixture &fixture : kFixtures) {
+        Input input, golden;
+        if (!fixtureInput(fixture.input, input) ||
+            !fileInput(goldens.filePath(QString(fixture.name) + ".png"), golden)) {
+            std::printf("{\"verify\":\"%s\",\"error\":\"missing input or golden image\",\"pass\":false}\n", fixture.name);
+            allPassed = false;
+            continue;
+        }
+
+        for (const Backend &backend : kBackends) {
+            WorkImage image;
+            std::vector<RGBA> pixels = input.pixels;
+            image.adopt(pixels, input.width, input.height);
+            for (const FilterStep &step : fixture.steps) {
+                applyFilterStep(image, step, backend.precision, backend.execution);
+            }
+            image.convertTo(ImageLayout::Interleaved);
+
+            int tolerance = backend.precision == FilterPrecision::FixedPoint ? fixture.fixedTolerance : 0;
+            ImageDifference diff = compareImages(image.pixels, image.width, image.height,
+                                                 golden.pixels, golden.width, golden.height, tolerance);
+            bool pass = diff.sameSize && diff.maxChannelDiff() <= tolerance;
+            allPassed = allPassed && pass;
+
+            char psnr[32] = "null";
+            if (std::isfinite(diff.psnr)) {
+                std::snprintf(psnr, sizeof(psnr), "%.2f", diff.psnr);
+            }
+            std::printf("{\"verify\":\"%s\",\"backend\":\"%s\",\"width\":%d,\"height\":%d,\"same_size\":%s,"
+                        "\"max_diff\":[%d,%d,%d,%d],\"pixels_over\":%zu,\"tolerance\":%d,\"psnr\":%s,\"pass\":%s}\n",
+                        fixture.name, backend.name, image.width, image.height, diff.sameSize ? "true" : "false",
+                        diff.maxDiff[0], diff.maxDiff[1], diff.maxDiff[2], diff.maxDiff[3], diff.pixelsOver,
+                        tolerance, psnr, pass ? "true" : "false");
+            std::fflush(stdout);
+        }
+    }
+    return allPassed;
+}
+
+/**
+ * @brief The median of medianImage() by definition: every channel of every
+ * pixel sorted out of its whole (2 * radius + 1) square, edges repeated
+ */
+static std::vector<RGBA> bruteForceMedian(const Input &input, int radius) {
+    int side = 2 * radius + 1;
+    std::vector<std::uint8_t> window(static_cast<size_t>(side) * side);
+    std::vector<RGBA> out(input.pixels.size());
+    for (int y = 0; y < input.height; y++) {
+        for (int x = 0; x < input.width; x++) {
+            RGBA &dst = out[static_cast<size_t>(y) * input.width + x];
+            dst = input.pixels[static_cast<size_t>(y) * input.width + x];
+            for (int c = 0; c < 3; c++) {
+                size_t i = 0;
+                for (int dy = -radius; dy <= radius; dy++) {
+                    for (int dx = -radius; dx <= radius; dx++) {
+                        const RGBA &src = input.pixels[static_cast<size_t>(std::clamp(y + dy, 0, input.height - 1)) * input.width +
+                                                       std::clamp(x + dx, 0, input.width - 1)];
+                        window[i++] = c == 0 ? src.r : c == 1 ? src.g : src.b;
+                    }
+                }
+                std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+                (c == 0 ? dst.r : c == 1 ? dst.g : dst.b) = window[window.size() / 2];
+            }
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Runs medianImage() on every backend over synthetic images, from one
+ * pixel to larger than a few windows and with varying alpha, and compares it
+ * exactly with bruteForceMedian(); prints one JSON line per comparison
+ * @return true if all comparisons passed
+ */
+static bool verifyMedian() {
+    bool allPassed = true;
+    for (auto [width, height] : {std::pair{1, 1}, {3, 2}, {17, 9}, {64, 48}, {203, 101}}) {
+        Input input = syntheticInput(width, height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                input.pixels[static_cast<size_t>(y) * width + x].a = static_cast<std::uint8_t>(x * 7 ^ y * 13);
+            }
+        }
+        for (int radius : {1, 2, 5}) {
+            std::vector<RGBA> expected = bruteForceMedian(input, radius);
+            for (const Backend &backend : kBackends) {
+                WorkImage image;
+                std::vector<RGBA> pixels = input.pixels;
+                image.adopt(pixels, width, height);
+                medianImage(image, radius, backend.execution);
+                image.convertTo(ImageLayout::Interleaved);
+
+                ImageDifference diff = compareImages(image.pixels, image.width, image.height,
+                                                     expected, width, height, 0);
+                bool pass = diff.within(0, 0.0);
+                allPassed = allPassed && pass;
+                std::printf("{\"verify\":\"median\",\"backend\":\"%s\",\"width\":%d,\"height\":%d,\"radius\":%d,"
+                            "\"max_diff\":[%d,%d,%d,%d],\"pixels_over\":%zu,\"pass\":%s}\n",
+                            backend.name, width, height, radius, diff.maxDiff[0], diff.maxDiff[1], diff.maxDiff[2],
+                            diff.maxDiff[3], diff.pixelsOver, pass ? "true" : "false");
+                std::fflush(stdout);
+            }
+        }
+    }
+    return allPassed;
+}
+
+/**
+ * @brief Checks that the SIMD table lookups of PointOp::apply() match the
+ * scalar ones for every byte value, with a tail shorter than a SIMD block
+ */
+static bool verifyPointOps() {
+    constexpr size_t kCount = 256 * 3 + 17;
+    std::vector<std::uint8_t> in[3];
+    for (int c = 0; c < 3; c++) {
+        in[c].resize(kCount);
+        for (size_t i = 0; i < kCount; i++) {
+            in[c][i] = static_cast<std::uint8_t>(i * (2 * c + 1) + c);
+        }
+    }
+    PointOp chain = PointOp::gamma(0.8f);
+    chain.append(PointOp::levels(10, 240));
+    chain.append(PointOp::curve({{0, 0}, {128, 150}, {255, 255}}));
+    const std::pair<const char *, PointOp> ops[] = {
+        {"gamma", PointOp::gamma(2.2f)}, {"levels", PointOp::levels(30, 200, 1.5f)},
+        {"curve", PointOp::curve({{0, 255}, {255, 0}})}, {"chain", chain}};
+
+    bool allPassed = true;
+    for (const auto &[name, op] : ops) {
+        std::vector<std::uint8_t> expected[3], actual[3];
+        for (int c = 0; c < 3; c++) {
+            expected[c].resize(kCount);
+            actual[c].resize(kCount);
+        }
+        op.apply(in[0].data(), in[1].data(), in[2].data(), kCount,
+                 expected[0].data(), expected[1].data(), expected[2].data(), false);
+        op.apply(in[0].data(), in[1].data(), in[2].data(), kCount,
+                 actual[0].data(), actual[1].data(), actual[2].data(), true);
+        bool pass = expected[0] == actual[0] && expected[1] == actual[1] && expected[2] == actual[2];
+        allPassed = allPassed && pass;
+        std::printf("{\"verify\":\"point\",\"op\":\"%s\",\"count\":%zu,\"pass\":%s}\n",
+                    name, kCount, pass ? "true" : "false");
+        std::fflush(stdout);
+    }
+    return allPassed;
+}
+
+// ------ BATCH ------
+
+/**
+ * @brief Writes every input at 1/8, 1/2, 1 and 2 times its size to tempDir
+ * as PNG, giving the scheduler a mix of tiny and large images
+ */
+static std::vector<BatchItem> batchCorpus(const QTemporaryDir &tempDir) {
+    std::vector<BatchItem> items;
+    QDir dir(g_options.imageDir);
+    for (const QString &file : dir.entryList({"*.png", "*.jpg", "*.jpeg"}, QDir::Files, QDir::Name)) {
+        QImage image;
+        if (!image.load(dir.filePath(file))) {
+            continue;
+        }
+        for (double scale : {0.125, 0.5, 1.0, 2.0}) {
+            QString name = QString("%1_%2").arg(QFileInfo(file).completeBaseName()).arg(scale);
+            QString input = tempDir.filePath("batch_in_" + name + ".png");
+            int width = std::max(1, static_cast<int>(std::lround(image.width() * scale)));
+            int height = std::max(1, static_cast<int>(std::lround(image.height() * scale)));
+            image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation).save(input);
+            items.push_back({input, tempDir.filePath("batch_out_" + name + ".png")});
+        }
+    }
+    return items;
+}
+
+// "stage":{...} member with the pipeline metrics of one stage
+static std::string stageJson(const char *name, const StageStats &stage) {
+    char json[256];
+    std::snprintf(json, sizeof(json), "\"%s\":{\"items\":%d,\"busy_s\":%.4f,\"utilization\":%.3f,"
+                  "\"queue_max\":%d,\"queue_mean\":%.3f}",
+                  name, stage.items, stage.busySeconds, stage.utilization, stage.maxQueueDepth, stage.meanQueueDepth);
+    return json;
+}
+
+/**
+ * @brief Blur and edge detection over the corpus in three scheduling modes,
+ * best of g_options.reps runs each. Times include PNG decode and encode, with
+ * the batch's fast encoder profile except in "tiles-default-save".
+ */
+static void benchBatch(const QTemporaryDir &tempDir) {
+    std::vector<BatchItem> items = batchCorpus(tempDir);
+    struct Mode {
+        const char *name;
+        bool concurrentImages;
+        bool tileTasks;
+        bool fastSave = true;
+    };
+    for (Mode mode : {Mode{"sequential", false, true}, Mode{"per-image", true, false}, Mode{"tiles", true, true},
+                      Mode{"tiles-default-save", true, true, false}}) {
+        BatchOptions options;
+        options.steps = {{FILTER_BLUR, 5, 0}, {FILTER_EDGE_DETECT, 0.5f, 0}};
+        options.concurrentImages = mode.concurrentImages;
+        options.tileTasks = mode.tileTasks;
+        if (!mode.fastSave) {
+            options.save = SaveOptions();
+        }
+
+        BatchStats best;
+        for (int rep = 0; rep < g_options.reps; rep++) {
+            BatchStats stats = runBatch(items, options);
+            if (rep == 0 || stats.seconds < best.seconds) {
+                best = stats;
+            }
+        }
+        std::printf("{\"bench\":\"batch\",\"param\":\"%s\",\"images\":%d,\"failed\":%d,\"megapixels\":%.3f,"
+                    "\"seconds\":%.4f,\"mp_per_s\":%.3f,\"images_per_s\":%.2f,\"peak_mp_in_flight\":%.3f,"
+                    "\"tasks\":%llu,\"steals\":%llu,%s,%s,%s}\n",
+                    mode.name, best.images, best.failed, best.pixels / 1e6, best.seconds,
+                    best.pixels / 1e6 / best.seconds, best.images / best.seconds, best.peakPixelsInFlight / 1e6,
+                    static_cast<unsigned long long>(best.tasks), static_cast<unsigned long long>(best.steals),
+                    stageJson("decode", best.decode).c_str(), stageJson("filter", best.filter).c_str(),
+                    stageJson("encode", best.encode).c_str());
+        std::fflush(stdout);
+    }
+}
+
+// ------ REPLAY ------
+
+/**
+ * @brief Replays a recording g_options.reps times and prints one JSON line
+ * @return true if every replay ended on the recorded checksum
+ */
+static bool replayRecording(const QString &file) {
+    StrokeRecording recording;
+    if (!loadStrokeRecording(QFile::encodeName(file).toStdString(), recording)) {
+        return false;
+    }
+    std::vector<RGBA> canvas;
+    std::vector<double> times;
+    ReplayResult result;
+    bool match = true;
+    for (int rep = 0; rep < g_options.reps; rep++) {
+        result = replayStrokes(recording, canvas);
+        times.push_back(result.seconds * 1e3);
+        match = match && result.checksum == recording.checksum;
+    }
+    std::sort(times.begin(), times.end());
+    double best = times.front();
+
+    std::printf("{\"replay\":\"%s\",\"width\":%d,\"height\":%d,\"strokes\":%zu,\"stamps\":%lld,"
+                "\"pixels_written\":%lld,\"reps\":%d,\"ms_min\":%.4f,\"ms_median\":%.4f,\"stamps_per_s\":%.1f,"
+                "\"checksum\":\"%016llx\",\"expected\":\"%016llx\",\"match\":%s}\n",
+                file.toStdString().c_str(), recording.width, recording.height, recording.strokes.size(),
+                static_cast<long long>(result.stamps), static_cast<long long>(result.pixelsWritten), g_options.reps,
+                best, times[times.size() / 2], best > 0 ? result.stamps / best * 1e3 : 0.0,
+                static_cast<unsigned long long>(result.checksum), static_cast<unsigned long long>(recording.checksum),
+                match ? "true" : "false");
+    std::fflush(stdout);
+    return match;
+}
+
+static bool parseArgs(const QStringList &args) {
+    for (int i = 1; i < args.size(); i++) {
+        const QString &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (arg == "--images" && hasValue) {
+            g_options.imageDir = args[++i];
+        } else if (arg == "--sizes" && hasValue) {
+            g_options.sizes.clear();
+            for (const QString &size : args[++i].split(',', Qt::SkipEmptyParts)) {
+                QStringList wh = size.split('x');
+                if (wh.size() != 2) {
+                    return false;
+                }
+                g_options.sizes.push_back({wh[0].toInt(), wh[1].toInt()});
+            }
+        } else if (arg == "--reps" && hasValue) {
+            g_options.reps = std::max(1, args[++i].toInt());
+        } else if (arg == "--filter" && hasValue) {
+            g_options.filter = args[++i].toStdString();
+        } else if (arg == "--golden" && hasValue) {
+            g_options.goldenDir = args[++i];
+        } else if (arg == "--trace" && hasValue) {
+            g_options.traceFile = args[++i];
+        } else if (arg == "--replay" && hasValue) {
+            g_options.replayFile = args[++i];
+        } else if (arg == "--verify") {
+            g_options.verify = true;
+        } else if (arg == "--batch") {
+            g_options.batch = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    // Canvas2D is a widget, but nothing needs to reach the screen
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    if (!parseArgs(app.arguments())) {
+        std::fprintf(stderr, "usage: %s [--images DIR] [--sizes WxH,...] [--reps N] [--filter TEXT] [--trace FILE]\n"
+                             "       %s --verify [--golden DIR] [--images DIR]\n"
+                             "       %s --batch [--images DIR] [--reps N]\n"
+                             "       %s --replay FILE [--reps N]\n", argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (!g_options.traceFile.isEmpty()) {
+        setTracingEnabled(true);
+    }
+    if (g_options.verify) {
+        bool passed = verifyFixtures();
+        passed = verifyMedian() && passed;
+        passed = verifyPointOps() && passed;
+        return passed ? 0 : 1;
+    }
+    if (!g_options.replayFile.isEmpty()) {
+        return replayRecording(g_options.replayFile) ? 0 : 1;
+    }
+
+    QTemporaryDir tempDir;
+    if (g_options.batch) {
+        benchBatch(tempDir);
+        return 0;
+    }
+
+    Canvas2D canvas;
+    canvas.init();
+
+    for (auto [width, height] : g_options.sizes) {
+        runAll(syntheticInput(width, height), canvas, tempDir);
+    }
+    // Statistics are cheap enough per pixel that only a large image shows
+    // their throughput; 50 MP, as from a current camera
+    if (selected("stats")) {
+        benchStats(syntheticInput(8192, 6144));
+    }
+
+    if (!g_options.imageDir.isEmpty()) {
+        QDir dir(g_options.imageDir);
+        for (const QString &file : dir.entryList({"*.png", "*.jpg", "*.jpeg"}, QDir::Files, QDir::Name)) {
+            Input input;
+            if (fileInput(dir.filePath(file), input)) {
+                runAll(input, canvas, tempDir);
+            }
+        }
+    }
+
+    if (!g_options.traceFile.isEmpty() && !exportChromeTrace(g_options.traceFile.toStdString())) {
+        std::fprintf(stderr, "failed to write %s\n", g_options.traceFile.toStdString().c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * @class BoundedQueue
+ *
+ * Blocking FIFO between two pipeline stages. push() waits while the queue
+ * holds `capacity` items, which is what throttles a stage that runs ahead
+ * of the next one. pop() waits for an item and returns false once the queue
+ * is closed and empty. All members are thread safe.
+ *
+ * The queue keeps its largest depth and its depth averaged over time, for
+ * the pipeline metrics.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(int capacity) : m_capacity(std::max(1, capacity)) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [&] { return static_cast<int>(m_items.size()) < m_capacity; });
+        account();
+        m_items.push_back(std::move(item));
+        m_maxDepth = std::max(m_maxDepth, static_cast<int>(m_items.size()));
+        lock.unlock();
+        m_notEmpty.notify_one();
+    }
+
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [&] { return !m_items.empty() || m_closed; });
+        if (m_items.empty()) {
+            return false;
+        }
+        account();
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // No more pushes; pop() drains what is left, then returns false
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+    }
+
+    int maxDepth() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_maxDepth;
+    }
+
+    double meanDepth() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        double elapsed = std::chrono::duration<double>(m_lastChange - m_created).count();
+        return elapsed > 0 ? m_depthSeconds / elapsed : 0.0;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T> m_items;
+    int m_capacity;
+    bool m_closed = false;
+
+    int m_maxDepth = 0;
+    double m_depthSeconds = 0;
+    Clock::time_point m_created = Clock::now();
+    Clock::time_point m_lastChange = m_created;
+
+    // Adds the time spent at the current depth; call before every change
+    void account() {
+        Clock::time_point now = Clock::now();
+        m_depthSeconds += m_items.size() * std::chrono::duration<double>(now - m_lastChange).count();
+        m_lastChange = now;
+    }
+};
+
+#endif // BOUNDEDQUEUE_H
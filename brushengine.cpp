@@ -0,0 +1,279 @@
+#include "brushengine.h"
+#include "colorspace.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Sizes the mask for `radius`; negative radii count as 0, a single
+ * pixel
+ */
+void BrushEngine::resizeMask(int radius){
+    radius = std::max(radius, 0);
+    m_radius = radius;
+    m_maskWidth = 2 * radius + 1;
+    m_maskHeight = 2 * radius + 1;
+    m_mask.assign(m_maskWidth * m_maskHeight, 0.0);
+}
+
+void BrushEngine::initConstantMask(int radius){
+    resizeMask(radius);
+    radius = m_radius;
+    for (int i = 0; i < m_maskWidth; i++){
+        for (int j = 0; j < m_maskHeight; j++){
+            float distance = sqrt(pow(i - radius, 2) + pow(j - radius, 2));
+            if (distance <= radius){
+                m_mask[j * m_maskWidth + i] = 1.0;
+            }
+        }
+    }
+}
+
+void BrushEngine::initLinearMask(int radius){
+    resizeMask(radius);
+    radius = m_radius;
+    if (radius == 0){
+        // the falloff below divides by the radius
+        m_mask[0] = 1.0;
+        return;
+    }
+    for (int i = 0; i < m_maskWidth; i++){
+        for (int j = 0; j < m_maskHeight; j++){
+            float distance = sqrt(pow(i - radius, 2) + pow(j - radius, 2));
+            if (distance <= radius){
+                float opacity = 1 - distance / radius;
+                m_mask[j * m_maskWidth + i] = opacity;
+            }
+        }
+    }
+}
+
+void BrushEngine::initQuadraticMask(int radius){
+    resizeMask(radius);
+    radius = m_radius;
+    if (radius == 0){
+        m_mask[0] = 1.0;
+        return;
+    }
+    for (int i = 0; i < m_maskWidth; i++){
+        for (int j = 0; j < m_maskHeight; j++){
+            float distance = sqrt(pow(i - radius, 2) + pow(j - radius, 2));
+            if (distance <= radius){
+                float A = 1.0 / pow(radius, 2);
+                float B = 2.0 / radius;
+                float opacity = A * pow(distance, 2) - B * distance + 1;
+                m_mask[j * m_maskWidth + i] = opacity;
+            }
+        }
+    }
+}
+
+/**
+ * @brief True once the brush has left the canvas completely, at which point
+ * the smudge pickup is dropped
+ */
+bool BrushEngine::outOfReach(int width, int height, int x, int y) const {
+    return x > m_radius + width || y > m_radius + height || x < -m_radius || y < -m_radius;
+}
+
+/**
+ * @brief The mask columns [i0, i1) and rows [j0, j1) that land on the canvas
+ * for a brush centered at (x, y). Empty ranges when the brush is off the
+ * canvas.
+ */
+void BrushEngine::clip(int width, int height, int x, int y, int &i0, int &i1, int &j0, int &j1) const {
+    i0 = std::max(0, m_radius - x);
+    i1 = std::min(m_maskWidth, width - x + m_radius);
+    j0 = std::max(0, m_radius - y);
+    j1 = std::min(m_maskHeight, height - y + m_radius);
+}
+
+/**
+ * @brief Composites a color given in linear light over a straight-alpha sRGB
+ * pixel, as premultiplied "over" with `coverage` as the source alpha
+ */
+static inline void blendLinear(RGBA &pixel, float red, float green, float blue, float coverage,
+                               const std::array<float, 256> &toLinear) {
+    float keep = pixel.a * (1.0f / 255) * (1 - coverage);
+    float alpha = coverage + keep;
+    float scale = 1 / alpha;
+    pixel.r = linearToSrgb((red * coverage + toLinear[pixel.r] * keep) * scale);
+    pixel.g = linearToSrgb((green * coverage + toLinear[pixel.g] * keep) * scale);
+    pixel.b = linearToSrgb((blue * coverage + toLinear[pixel.b] * keep) * scale);
+    pixel.a = static_cast<std::uint8_t>(alpha * 255 + 0.5f);
+}
+
+/**
+ * @brief Opaque pixels stay opaque under "over", which then reduces to a
+ * lerp in linear light. Done on srgbToLinearStepTable() indices with
+ * `weight` in 4096ths (coarser weights visibly band faint paint over dark
+ * pixels), so it costs no division.
+ */
+static inline std::uint8_t lerpLinearSteps(std::uint8_t from, int to, int weight,
+                                           const std::array<std::uint16_t, 256> &steps,
+                                           const std::array<std::uint8_t, kLinearSteps> &toSrgb) {
+    return toSrgb[(to * weight + steps[from] * (4096 - weight) + 2048) >> 12];
+}
+
+// Coverage in (0, 1] as a lerpLinearSteps() weight; clamped, so the table
+// index stays in range whatever the mask holds
+static inline int stepWeight(float coverage) {
+    return std::clamp(static_cast<int>(coverage * 4096 + 0.5f), 0, 4096);
+}
+
+int BrushEngine::footprint(int width, int height, int x, int y) const {
+    int i0, i1, j0, j1;
+    clip(width, height, x, y, i0, i1, j0, j1);
+    return std::max(0, i1 - i0) * std::max(0, j1 - j0);
+}
+
+void BrushEngine::pickUp(const std::vector<RGBA> &canvas, int width, int height, int x, int y){
+    TRACE_SPAN("brush.pickUp");
+    m_pickup.assign(m_maskWidth * m_maskHeight, RGBA{0, 0, 0, 0});
+    if (outOfReach(width, height, x, y)){
+        return;
+    }
+
+    int i0, i1, j0, j1;
+    clip(width, height, x, y, i0, i1, j0, j1);
+    for (int j = j0; j < j1; j++){
+        int row = (y + j - m_radius) * width + x - m_radius;
+        for (int i = i0; i < i1; i++){
+            m_pickup[j * m_maskWidth + i] = canvas[row + i];
+        }
+    }
+}
+
+void BrushEngine::stamp(std::vector<RGBA> &canvas, int width, int height, int x, int y, RGBA color){
+    TRACE_SPAN("brush.stamp");
+    int i0, i1, j0, j1;
+    clip(width, height, x, y, i0, i1, j0, j1);
+
+    if (m_linearBlending){
+        const std::array<float, 256> &toLinear = srgbToLinearTable();
+        const std::array<std::uint16_t, 256> &steps = srgbToLinearStepTable();
+        const std::array<std::uint8_t, kLinearSteps> &toSrgb = linearToSrgbTable();
+        float alpha = color.a / 255.0f;
+        float red = toLinear[color.r];
+        float green = toLinear[color.g];
+        float blue = toLinear[color.b];
+        int redStep = steps[color.r];
+        int greenStep = steps[color.g];
+        int blueStep = steps[color.b];
+        for (int j = j0; j < j1; j++){
+            const float *mask = &m_mask[j * m_maskWidth];
+            int row = (y + j - m_radius) * width + x - m_radius;
+            for (int i = i0; i < i1; i++){
+                float coverage = alpha * mask[i];
+                if (!(coverage > 0)){
+                    // also skips NaN
+                    continue;
+                }
+                coverage = std::min(coverage, 1.0f);
+                RGBA &pixel = canvas[row + i];
+                if (pixel.a == 255){
+                    int weight = stepWeight(coverage);
+                    pixel.r = lerpLinearSteps(pixel.r, redStep, weight, steps, toSrgb);
+                    pixel.g = lerpLinearSteps(pixel.g, greenStep, weight, steps, toSrgb);
+                    pixel.b = lerpLinearSteps(pixel.b, blueStep, weight, steps, toSrgb);
+                } else {
+                    blendLinear(pixel, red, green, blue, coverage, toLinear);
+                }
+            }
+        }
+        return;
+    }
+
+    float alpha = color.a / 255.0;
+    for (int j = j0; j < j1; j++){
+        const float *mask = &m_mask[j * m_maskWidth];
+        int row = (y + j - m_radius) * width + x - m_radius;
+        for (int i = i0; i < i1; i++){
+            float opacity = mask[i];
+            if (opacity == 0){
+                continue;
+            }
+            RGBA &pixel = canvas[row + i];
+            pixel.r = (alpha * opacity) * color.r + (1 - alpha * opacity) * pixel.r;
+            pixel.g = (alpha * opacity) * color.g + (1 - alpha * opacity) * pixel.g;
+            pixel.b = (alpha * opacity) * color.b + (1 - alpha * opacity) * pixel.b;
+        }
+    }
+}
+
+void BrushEngine::smudge(std::vector<RGBA> &canvas, int width, int height, int x, int y){
+    TRACE_SPAN("brush.smudge");
+    if (outOfReach(width, height, x, y)){
+        m_pickup.assign(m_maskWidth * m_maskHeight, RGBA{0, 0, 0, 0});
+    }
+
+    int i0, i1, j0, j1;
+    clip(width, height, x, y, i0, i1, j0, j1);
+
+    if (m_linearBlending){
+        // The paint is deposited with "over" and then takes up the pixel
+        // under it, both in premultiplied linear light
+        const std::array<float, 256> &toLinear = srgbToLinearTable();
+        const std::array<std::uint16_t, 256> &steps = srgbToLinearStepTable();
+        const std::array<std::uint8_t, kLinearSteps> &toSrgb = linearToSrgbTable();
+        for (int j = j0; j < j1; j++){
+            int row = (y + j - m_radius) * width + x - m_radius;
+            for (int i = i0; i < i1; i++){
+                float opacity = m_mask[j * m_maskWidth + i];
+                if (!(opacity > 0)){
+                    // leaves both the pixel and the paint as they are;
+                    // also skips NaN
+                    continue;
+                }
+                opacity = std::min(opacity, 1.0f);
+                RGBA &paint = m_pickup[j * m_maskWidth + i];
+                RGBA &pixel = canvas[row + i];
+                if (paint.a == 255 && pixel.a == 255){
+                    int weight = stepWeight(opacity);
+                    pixel.r = lerpLinearSteps(pixel.r, steps[paint.r], weight, steps, toSrgb);
+                    pixel.g = lerpLinearSteps(pixel.g, steps[paint.g], weight, steps, toSrgb);
+                    pixel.b = lerpLinearSteps(pixel.b, steps[paint.b], weight, steps, toSrgb);
+                    paint.r = lerpLinearSteps(paint.r, steps[pixel.r], weight, steps, toSrgb);
+                    paint.g = lerpLinearSteps(paint.g, steps[pixel.g], weight, steps, toSrgb);
+                    paint.b = lerpLinearSteps(paint.b, steps[pixel.b], weight, steps, toSrgb);
+                    continue;
+                }
+
+                float coverage = opacity * paint.a * (1.0f / 255);
+                if (coverage > 0){
+                    blendLinear(pixel, toLinear[paint.r], toLinear[paint.g], toLinear[paint.b], coverage, toLinear);
+                }
+
+                float take = opacity * pixel.a * (1.0f / 255);
+                float keep = (1 - opacity) * paint.a * (1.0f / 255);
+                float alpha = take + keep;
+                if (alpha > 0){
+                    float scale = 1 / alpha;
+                    paint.r = linearToSrgb((toLinear[pixel.r] * take + toLinear[paint.r] * keep) * scale);
+                    paint.g = linearToSrgb((toLinear[pixel.g] * take + toLinear[paint.g] * keep) * scale);
+                    paint.b = linearToSrgb((toLinear[pixel.b] * take + toLinear[paint.b] * keep) * scale);
+                }
+                paint.a = static_cast<std::uint8_t>(alpha * 255 + 0.5f);
+            }
+        }
+        return;
+    }
+
+    for (int j = j0; j < j1; j++){
+        int row = (y + j - m_radius) * width + x - m_radius;
+        for (int i = i0; i < i1; i++){
+            float opacity = m_mask[j * m_maskWidth + i];
+            RGBA &paint = m_pickup[j * m_maskWidth + i];
+            RGBA &pixel = canvas[row + i];
+            float alpha = (float)paint.a / 255;
+
+            pixel.r = 0.5f + alpha * opacity * paint.r + (1 - alpha * opacity) * pixel.r;
+            pixel.g = 0.5f + alpha * opacity * paint.g + (1 - alpha * opacity) * pixel.g;
+            pixel.b = 0.5f + alpha * opacity * paint.b + (1 - alpha * opacity) * pixel.b;
+
+            paint.r = 0.5f + opacity * pixel.r + (1 - opacity) * paint.r;
+            paint.g = 0.5f + opacity * pixel.g + (1 - opacity) * paint.g;
+            paint.b = 0.5f + opacity * pixel.b + (1 - opacity) * paint.b;
+        }
+    }
+}
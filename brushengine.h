@@ -0,0 +1,53 @@
+#ifndef BRUSHENGINE_H
+#define BRUSHENGINE_H
+
+#include <vector>
+#include "rgba.h"
+
+/**
+ * @class BrushEngine
+ *
+ * Brush masks and stamping, independent of the widget so strokes can also be
+ * run headlessly. A mask is built once per stroke (or settings change) and
+ * then stamped onto a width x height canvas at each mouse position.
+ *
+ * By default paint is mixed the way it always was: straight alpha in sRGB,
+ * ignoring the canvas alpha. With linear blending, stamps and smudges are
+ * composited as premultiplied "over" in linear light (see colorspace.h) and
+ * write the resulting alpha back to the canvas.
+ */
+class BrushEngine {
+public:
+    void initConstantMask(int radius);
+    void initLinearMask(int radius);
+    void initQuadraticMask(int radius);
+
+    // Picks up the canvas under the brush for smudging
+    void pickUp(const std::vector<RGBA> &canvas, int width, int height, int x, int y);
+
+    // Blends `color` into the canvas through the mask, centered at (x, y)
+    void stamp(std::vector<RGBA> &canvas, int width, int height, int x, int y, RGBA color);
+    // Blends the picked up paint into the canvas, centered at (x, y)
+    void smudge(std::vector<RGBA> &canvas, int width, int height, int x, int y);
+
+    // Follows settings.fixAlphaBlending in the GUI
+    void setLinearBlending(bool enabled) { m_linearBlending = enabled; }
+
+    int radius() const { return m_radius; }
+    // Canvas pixels under the mask's square for a stamp at (x, y)
+    int footprint(int width, int height, int x, int y) const;
+
+private:
+    int m_radius = 0;
+    bool m_linearBlending = false;
+    int m_maskWidth = 0;
+    int m_maskHeight = 0;
+    std::vector<float> m_mask;
+    std::vector<RGBA> m_pickup;
+
+    void resizeMask(int radius);
+    bool outOfReach(int width, int height, int x, int y) const;
+    void clip(int width, int height, int x, int y, int &i0, int &i1, int &j0, int &j1) const;
+};
+
+#endif // BRUSHENGINE_H
@@ -1,16 +1,95 @@
 #include "canvas2d.h"
 #include <QPainter>
 #include <QMessageBox>
+#include <QFile>
 #include <QFileDialog>
 #include <iostream>
+#include "batch.h"
+#include "rawimage.h"
 #include "settings.h"
+#include "trace.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+
+// Longest side of the live preview proxy, in pixels
+static constexpr int kPreviewSize = 512;
+
+/**
+ * @brief The filter selected in the UI and its parameters
+ */
+static FilterStep selectedFilterStep() {
+    switch (settings.filterType) {
+    case FILTER_BLUR:
+        return {FILTER_BLUR, static_cast<float>(settings.blurRadius), 0};
+    case FILTER_EDGE_DETECT:
+        return {FILTER_EDGE_DETECT, settings.edgeDetectSensitivity, 0};
+    case FILTER_SCALE:
+        return {FILTER_SCALE, settings.scaleX, settings.scaleY};
+    case FILTER_MEDIAN:
+        return {FILTER_MEDIAN, static_cast<float>(settings.medianRadius), 0};
+    case FILTER_CHROMATIC:
+        return {FILTER_CHROMATIC, static_cast<float>(settings.rShift), static_cast<float>(settings.gShift),
+                static_cast<float>(settings.bShift)};
+    case FILTER_ROTATION:
+        return {FILTER_ROTATION, settings.rotationAngle, 0};
+    case FILTER_MAPPING:
+        return {FILTER_MAPPING, settings.gamma, settings.nonLinearMap ? 1.0f : 0.0f};
+    default:
+        return {settings.filterType, 0, 0};
+    }
+}
+
+/**
+ * @brief A filter run on a snapshot of the canvas, with the settings it was
+ * started with
+ */
+struct Canvas2D::FilterJob {
+    JobControl control;
+    WorkImage work;
+    std::vector<RGBA> pixels;
+    int width;
+    int height;
+
+    FilterStep step;
+    FilterPrecision precision;
+    Execution execution;
+
+    void run();
+};
+
+void Canvas2D::FilterJob::run() {
+    TRACE_SPAN("filterJob");
+    work.adopt(pixels, width, height);
+    applyFilterStep(work, step, precision, execution);
+    work.release(pixels);
+    width = work.width;
+    height = work.height;
+}
+
+Canvas2D::~Canvas2D() {
+    cancelFilter();
+    clearPreview();
+    m_filterPool.waitForDone();
+    m_previewPool.waitForDone();
+}
 
 /**
  * @brief Initializes new 500x500 canvas
  */
 void Canvas2D::init() {
     setMouseTracking(true);
+    m_filterPool.setMaxThreadCount(1);
+    m_progressTimer.setInterval(100);
+    connect(&m_progressTimer, &QTimer::timeout, this, [this]{
+        if (m_filterJob) {
+            emit filterProgress(static_cast<int>(m_filterJob->control.progress() * 100));
+        }
+    });
+    m_previewPool.setMaxThreadCount(1);
+    m_previewTimer.setSingleShot(true);
+    m_previewTimer.setInterval(40);
+    connect(&m_previewTimer, &QTimer::timeout, this, &Canvas2D::startPreview);
     m_width = 500;
     m_height = 500;
     clearCanvas();
@@ -20,6 +99,9 @@ void Canvas2D::init() {
  * @brief Canvas2D::clearCanvas sets all canvas pixels to blank white
  */
 void Canvas2D::clearCanvas() {
+    cancelFilter();
+    clearPreview();
+    m_sharesSource = false;
     m_data.assign(m_width * m_height, RGBA{255, 255, 255, 255});
     settings.imagePath = "";
     displayImage();
@@ -29,55 +111,146 @@ void Canvas2D::clearCanvas() {
  * @brief Stores the image specified from the input file in this class's
  * `std::vector<RGBA> m_image`.
  * Also saves the image width and height to canvas width and height respectively.
+ * The decoded pixels are kept as the immutable source used by revertImage().
+ * .rimg files are read directly (see rawimage.h); anything else goes through
+ * Qt's image codecs.
  * @param file: file path to an image
  * @return True if successfully loads image, False otherwise.
  */
 bool Canvas2D::loadImageFromFile(const QString &file) {
-    QImage myImage;
-    if (!myImage.load(file)) {
-        std::cout<<"Failed to load in image"<<std::endl;
-        return false;
+    TRACE_SPAN("loadImage");
+    cancelFilter();
+    clearPreview();
+    auto source = std::make_shared<std::vector<RGBA>>();
+    int width = 0;
+    int height = 0;
+    if (isRawImagePath(file.toStdString())) {
+        if (!loadRawImage(QFile::encodeName(file).toStdString(), *source, width, height)) {
+            std::cout<<"Failed to load in image"<<std::endl;
+            return false;
+        }
+    } else {
+        QImage myImage;
+        if (!myImage.load(file)) {
+            std::cout<<"Failed to load in image"<<std::endl;
+            return false;
+        }
+        myImage = myImage.convertToFormat(QImage::Format_RGBX8888);
+        width = myImage.width();
+        height = myImage.height();
+
+        // RGBX8888 stores bytes as R,G,B,X which is exactly the layout of RGBA
+        source->resize(width * height);
+        for (int row = 0; row < height; row++){
+            std::memcpy(source->data() + row * width, myImage.constScanLine(row), width * sizeof(RGBA));
+        }
     }
-    myImage = myImage.convertToFormat(QImage::Format_RGBX8888);
-    m_width = myImage.width();
-    m_height = myImage.height();
-    QByteArray arr = QByteArray::fromRawData((const char*) myImage.bits(), myImage.sizeInBytes());
-
-    m_data.clear();
-    m_data.reserve(m_width * m_height);
-    for (int i = 0; i < arr.size() / 4.f; i++){
-        m_data.push_back(RGBA{(std::uint8_t) arr[4*i], (std::uint8_t) arr[4*i+1], (std::uint8_t) arr[4*i+2], (std::uint8_t) arr[4*i+3]});
+
+    m_source = std::move(source);
+    m_sourcePath = file;
+    m_sourceWidth = width;
+    m_sourceHeight = height;
+    m_width = m_sourceWidth;
+    m_height = m_sourceHeight;
+    m_sharesSource = true;
+    displayImage();
+    return true;
+}
+
+/**
+ * @brief Restores the canvas to the image last loaded from the given file.
+ * If that image is still cached this only re-points the canvas at the
+ * decoded source; otherwise the file is decoded again.
+ * @param file: file path to an image
+ * @return True if the image was restored, False otherwise.
+ */
+bool Canvas2D::revertImage(const QString &file) {
+    if (!m_source || file != m_sourcePath) {
+        m_sourceCacheMisses++;
+        return loadImageFromFile(file);
     }
+    cancelFilter();
+    clearPreview();
+    m_sourceCacheHits++;
+    m_width = m_sourceWidth;
+    m_height = m_sourceHeight;
+    m_sharesSource = true;
     displayImage();
     return true;
 }
 
+/**
+ * @brief Returns the pixels currently shown on the canvas, which are the
+ * cached source until something writes to the canvas.
+ */
+const std::vector<RGBA> &Canvas2D::pixels() const {
+    return m_sharesSource ? *m_source : m_data;
+}
+
+/**
+ * @brief Gives m_data its own copy of the source before the first write.
+ * m_data keeps its capacity between images, so repeated reverts of the same
+ * image do not allocate.
+ */
+void Canvas2D::detachFromSource() {
+    if (!m_sharesSource) {
+        return;
+    }
+    TRACE_SPAN("detachFromSource");
+    m_data.assign(m_source->begin(), m_source->end());
+    m_sharesSource = false;
+}
+
 /**
  * @brief Saves the current canvas image to the specified file path.
  * @param file: file path to save image to
+ * @param options: encoder settings, see imagesave.h
  * @return True if successfully saves image, False otherwise.
  */
-bool Canvas2D::saveImageToFile(const QString &file) {
-    QImage myImage = QImage(m_width, m_height, QImage::Format_RGBX8888);
-    for (int i = 0; i < m_data.size(); i++){
-        myImage.setPixelColor(i % m_width, i / m_width, QColor(m_data[i].r, m_data[i].g, m_data[i].b, m_data[i].a));
-    }
-    if (!myImage.save(file)) {
-        std::cout<<"Failed to save image"<<std::endl;
-        return false;
-    }
-    return true;
+bool Canvas2D::saveImageToFile(const QString &file, const SaveOptions &options) {
+    TRACE_SPAN("saveImage");
+    return saveImage(file, pixels().data(), m_width, m_height, options);
 }
 
 
 /**
- * @brief Get Canvas2D's image data and display this to the GUI
+ * @brief Get Canvas2D's image data and display this to the GUI. Call this
+ * whenever the canvas is replaced as a whole; brush strokes only repaint the
+ * area they touch. The pixels are drawn straight from the canvas (or the
+ * pyramid level for the zoom) in paintEvent().
  */
 void Canvas2D::displayImage() {
-    QByteArray* img = new QByteArray(reinterpret_cast<const char*>(m_data.data()), 4*m_data.size());
-    QImage now = QImage((const uchar*)img->data(), m_width, m_height, QImage::Format_RGBX8888);
-    setPixmap(QPixmap::fromImage(now));
-    setFixedSize(m_width, m_height);
+    TRACE_SPAN("displayImage");
+    m_pyramid.reset(m_width, m_height);
+    fitToContent(m_width, m_height);
+    update();
+}
+
+/**
+ * @brief Returns the mip pyramid of the canvas with all dirty tiles rebuilt
+ */
+const MipPyramid &Canvas2D::pyramid() {
+    m_pyramid.update(pixels().data(), m_execution);
+    return m_pyramid;
+}
+
+/**
+ * @brief Sizes the widget for a width x height image at the current zoom
+ */
+void Canvas2D::fitToContent(int width, int height) {
+    int scale = 1 << displayLevel();
+    setFixedSize(std::max(1, (width + scale - 1) / scale), std::max(1, (height + scale - 1) / scale));
+}
+
+void Canvas2D::setZoomLevel(int level) {
+    m_zoomLevel = std::max(0, level);
+    if (m_previewImage.isNull()) {
+        fitToContent(m_width, m_height);
+    } else if (m_previewEnabled) {
+        // The preview keeps its own size; let the next one pick up the zoom
+        clearPreview();
+        m_previewTimer.start();
+    }
     update();
 }
 
@@ -87,6 +260,9 @@ void Canvas2D::displayImage() {
  * @param h
  */
 void Canvas2D::resize(int w, int h) {
+    cancelFilter();
+    clearPreview();
+    detachFromSource();
     m_width = w;
     m_height = h;
     m_data.resize(w * h);
@@ -97,453 +273,209 @@ void Canvas2D::resize(int w, int h) {
  * @brief Called when the filter button is pressed in the UI
  */
 void Canvas2D::filterImage() {
-    // Filter TODO: apply the currently selected filter to the loaded image
-    temp_sobel_image.assign(m_data.size(), SOBELIMG{0.0, 0.0, 0.0, 255});
-    if (settings.filterType == FILTER_BLUR){
-        int radius = settings.blurRadius;
-        std::vector<float> filter = filterBlur(radius);
-        int filter_length = 2 * radius + 1;
-        convolve(m_data, m_width, m_height, filter, filter_length, 1, false);
-        convolve(m_data, m_width, m_height, filter, 1, filter_length, false);
-    }else if (settings.filterType == FILTER_EDGE_DETECT){
-        float sensitivity = settings.edgeDetectSensitivity;
-        std::vector<RGBA> result = filterSobel(sensitivity);
-        m_data = result;
-    }else if (settings.filterType == FILTER_SCALE){
-        float x = settings.scaleX;
-        float y = settings.scaleY;
-        std::vector<RGBA> intermediate;
-        intermediate = filterScaling(m_data, m_width, m_height, x, 1.0f, true);
-        std::vector<RGBA> result = filterScaling(intermediate, newWidth, newHeight, 1.0f, y, false);
-        m_width = newWidth;
-        m_height = newHeight;
-        m_data = result;
-    }
-    displayImage();
+    TRACE_SPAN("filterImage");
+    cancelFilter();
+    clearPreview();
+
+    auto job = std::make_shared<FilterJob>();
+    job->pixels = pixels();
+    job->width = m_width;
+    job->height = m_height;
+    job->step = selectedFilterStep();
+    job->precision = m_precision;
+    job->execution = m_execution;
+    job->execution.job = &job->control;
+    // Lend the job our buffers so their planes are reused between filters
+    job->work = std::move(m_work);
+
+    m_filterJob = job;
+    m_filterPool.start([this, job]{
+        job->run();
+        QMetaObject::invokeMethod(this, [this, job]{ finishFilter(job); }, Qt::QueuedConnection);
+    });
+    m_progressTimer.start();
+    emit filterStarted();
 }
 
 /**
- * @brief Called when any of the parameters in the UI are modified.
+ * @brief Stops the running filter, if any. The canvas keeps its current
+ * contents; the worker finishes its row and its result is dropped.
  */
-void Canvas2D::settingsChanged() {
-    // this saves your UI settings locally to load next time you run the program
-    settings.saveSettings();
-    int radius = settings.brushRadius;
-
-    if (settings.brushType == BRUSH_CONSTANT){
-        initConstantMask(radius);
-    }else if (settings.brushType == BRUSH_LINEAR){
-        initLinearMask(radius);
-    }else if (settings.brushType == BRUSH_QUADRATIC){
-        initQuadraticMask(radius);
-    }else if (settings.brushType == BRUSH_SMUDGE){
-        initLinearMask(radius);
+void Canvas2D::cancelFilter() {
+    if (!m_filterJob) {
+        return;
     }
-
-    // TODO: fill in what you need to do when brush or filter parameters change
+    m_filterJob->control.cancel();
+    m_filterJob.reset();
+    m_progressTimer.stop();
+    emit filterFinished(false);
 }
-void Canvas2D::initConstantMask(int radius){
-    mask_width = 2 * radius + 1;
-    mask_height = 2 * radius + 1;
-    mask.assign(mask_width * mask_height, 0.0);
-    for (int i = 0; i < mask_width; i++){
-        for (int j = 0; j < mask_height; j++){
-            float distance = sqrt(pow(i - radius, 2) + pow(j - radius, 2));
-            if (distance <= radius){
-                mask.at(j *mask_width + i) = 1.0;
-            }
-        }
-    }
 
-
-}
-void Canvas2D::initLinearMask(int radius){
-    mask_width = 2 * radius + 1;
-    mask_height = 2 * radius + 1;
-    mask.assign(mask_width * mask_height, 0.0);
-    for (int i = 0; i < mask_width; i++){
-        for (int j = 0; j < mask_height; j++){
-            float distance = sqrt(pow(i - radius, 2) + pow(j - radius, 2));
-            if (distance <= radius){
-                float opacity = 1 - distance / radius;
-                mask.at(j *mask_width + i) = opacity;
-            }
-        }
-    }
-}
-
-void Canvas2D::initQuadraticMask(int radius){
-    mask_width = 2 * radius + 1;
-    mask_height = 2 * radius + 1;
-    mask.assign(mask_width * mask_height, 0.0);
-    for (int i = 0; i < mask_width; i++){
-        for (int j = 0; j < mask_height; j++){
-            float distance = sqrt(pow(i - radius, 2) + pow(j - radius, 2));
-            if (distance <= radius){
-                float A = 1.0 / pow(radius, 2);
-                float B = 2.0 / radius;
-                float opacity = A * pow(distance, 2) - B * distance + 1;
-                mask.at(j *mask_width + i) = opacity;
-            }
-        }
-    }
-}
-
-void Canvas2D::initSmudgeMask(int x, int y, int radius){
-    mask_width = 2 * radius + 1;
-    mask_height = 2 * radius + 1;
-    smudge_pickup.assign(mask_width * mask_height, RGBA{0, 0, 0, 0});
-
-    for (int i = 0; i < mask_width; i++){
-        for (int j = 0; j < mask_height; j++){
-            int canvas_x = x + i - radius;
-            int canvas_y = y + j - radius;
-            if (canvas_x >= m_width || canvas_y >= m_height || canvas_x < 0 || canvas_y < 0){
-                smudge_pickup[j *mask_width + i].b = 0.0;
-                smudge_pickup[j *mask_width + i].g = 0.0;
-                smudge_pickup[j *mask_width + i].r = 0.0;
-                smudge_pickup[j *mask_width + i].a = 0.0;
-                continue;
-            }
-            smudge_pickup[j *mask_width + i].b = m_data[maskToCanvas(i, j, x, y, radius)].b;
-            smudge_pickup[j *mask_width + i].g = m_data[maskToCanvas(i, j, x, y, radius)].g;
-            smudge_pickup[j *mask_width + i].r = m_data[maskToCanvas(i, j, x, y, radius)].r;
-            smudge_pickup[j *mask_width + i].a = m_data[maskToCanvas(i, j, x, y, radius)].a;
-        }
-    }
-    if (checkClearSmudge(x, y) == true){
-
-        smudge_pickup.assign(mask_width * mask_height, RGBA{0, 0, 0, 0});
+/**
+ * @brief Runs on the GUI thread once a job is done, and swaps its result
+ * into the canvas unless the job was cancelled in the meantime
+ */
+void Canvas2D::finishFilter(const std::shared_ptr<FilterJob> &job) {
+    m_work = std::move(job->work);
+    if (job != m_filterJob) {
+        return;
     }
-}
+    m_filterJob.reset();
+    m_progressTimer.stop();
 
-int Canvas2D::posToIndex(int x, int y){
-    return y * m_width + x;
+    m_data.swap(job->pixels);
+    m_width = job->width;
+    m_height = job->height;
+    m_sharesSource = false;
+    displayImage();
+    emit filterProgress(100);
+    emit filterFinished(true);
 }
-int Canvas2D::maskToCanvas(int x, int y, int canvas_x, int canvas_y, int radius){
-    int new_x = canvas_x + x - radius;
-    int new_y = canvas_y + y - radius;
-    int ret = posToIndex(new_x, new_y);
-    return ret;
 
-}
+// ------ LIVE PREVIEW ------
 
-bool Canvas2D::checkClearSmudge(int x, int y){
-     int radius = settings.brushRadius;
-    if (x > radius + m_width || y > radius + m_height || x <  - radius || y < - radius){
-        return true;
-    }else{
-        return false;
+void Canvas2D::setPreviewEnabled(bool enabled) {
+    m_previewEnabled = enabled;
+    if (enabled) {
+        m_previewTimer.start();
+    } else {
+        clearPreview();
     }
 }
 
-void Canvas2D::brush(int x, int y){
-    int radius = settings.brushRadius;
-    RGBA color = settings.brushColor;
-    float alpha = color.a / 255.0;
-
-
-    for (int i = 0; i < mask_width; i++){
-        for (int j = 0; j < mask_height; j++){
-            int canvas_x = x + i - radius;
-            int canvas_y = y + j - radius;
-            if (canvas_x >= m_width || canvas_y >= m_height || canvas_x < 0 || canvas_y < 0){
-                continue;
-            }else{
-                float opacity = mask[j *mask_width + i];
-                m_data[posToIndex(canvas_x, canvas_y)].r = (alpha * opacity) * color.r + (1 - alpha * opacity) * m_data[posToIndex(canvas_x, canvas_y)].r;
-                m_data[posToIndex(canvas_x, canvas_y)].g = (alpha * opacity) * color.g + (1 - alpha * opacity) * m_data[posToIndex(canvas_x, canvas_y)].g;
-                m_data[posToIndex(canvas_x, canvas_y)].b = (alpha * opacity) * color.b + (1 - alpha * opacity) * m_data[posToIndex(canvas_x, canvas_y)].b;
-            }
-        }
+/**
+ * @brief Runs the selected filter on the proxy, the first pyramid level that
+ * fits in kPreviewSize. Blur and median radii and channel shifts are scaled
+ * down with the proxy so the preview looks like the full-resolution result;
+ * the median keeps a radius of at least 1.
+ */
+void Canvas2D::startPreview() {
+    if (!m_previewEnabled || m_filterJob) {
+        return;
     }
-
-}
-
-void Canvas2D::brushSmudge(int x, int y){
-    int radius = settings.brushRadius;
-    if (checkClearSmudge(x, y) == true){
-        smudge_pickup.assign(mask_width * mask_height, RGBA{0, 0, 0, 0});
+    TRACE_SPAN("startPreview");
+    if (m_previewJob) {
+        m_previewJob->control.cancel();
     }
-
-    for (int i = 0; i < mask_width; i++){
-        for (int j = 0; j < mask_height; j++){
-            int canvas_x = x + i - radius;
-            int canvas_y = y + j - radius;
-            if (canvas_x >= m_width || canvas_y >= m_height || canvas_x < 0 || canvas_y < 0){
-                continue;
-            }else{
-                float opacity = mask[j *mask_width + i];
-                float alpha = (float)smudge_pickup[j *mask_width + i].a / 255;
-
-                m_data[posToIndex(canvas_x, canvas_y)].r = 0.5f + alpha * opacity * smudge_pickup[j *mask_width + i].r + (1 - alpha * opacity) * m_data[posToIndex(canvas_x, canvas_y)].r;
-                m_data[posToIndex(canvas_x, canvas_y)].g = 0.5f + alpha * opacity * smudge_pickup[j *mask_width + i].g + (1 - alpha * opacity) * m_data[posToIndex(canvas_x, canvas_y)].g;
-                m_data[posToIndex(canvas_x, canvas_y)].b = 0.5f + alpha * opacity * smudge_pickup[j *mask_width + i].b + (1 - alpha * opacity) * m_data[posToIndex(canvas_x, canvas_y)].b;
-
-                smudge_pickup[j *mask_width + i].r = 0.5f + opacity * m_data[posToIndex(canvas_x, canvas_y)].r + (1 - opacity) * smudge_pickup[j *mask_width + i].r;
-                smudge_pickup[j *mask_width + i].g = 0.5f + opacity * m_data[posToIndex(canvas_x, canvas_y)].g + (1 - opacity) * smudge_pickup[j *mask_width + i].g;
-                smudge_pickup[j *mask_width + i].b = 0.5f + opacity * m_data[posToIndex(canvas_x, canvas_y)].b + (1 - opacity) * smudge_pickup[j *mask_width + i].b;
-            }
-        }
+    const MipPyramid &levels = pyramid();
+    int level = levels.levelAtMost(kPreviewSize);
+
+    auto job = std::make_shared<FilterJob>();
+    job->pixels = level == 0 ? pixels() : levels.pixels(level);
+    job->width = levels.width(level);
+    job->height = levels.height(level);
+    job->step = selectedFilterStep();
+    if (job->step.filterType == FILTER_BLUR) {
+        job->step.a = std::lround(job->step.a / (1 << level));
+    } else if (job->step.filterType == FILTER_MEDIAN) {
+        job->step.a = std::max(std::lround(job->step.a / (1 << level)), 1L);
+    } else if (job->step.filterType == FILTER_CHROMATIC) {
+        job->step.a = std::lround(job->step.a / (1 << level));
+        job->step.b = std::lround(job->step.b / (1 << level));
+        job->step.c = std::lround(job->step.c / (1 << level));
     }
-
-}
-// Repeats the pixel on the edge of the image such that A,B,C,D looks like ...A,A,A,B,C,D,D,D...
-int Canvas2D::getPixelRepeated(int width, int height, int x, int y) {
-    int newX = (x < 0) ? 0 : std::min(x, width  - 1);
-    int newY = (y < 0) ? 0 : std::min(y, height - 1);
-    return width * newY + newX;
+    job->precision = m_precision;
+    job->execution = m_execution;
+    job->execution.job = &job->control;
+    job->work = std::move(m_previewWork);
+
+    m_previewJob = job;
+    m_previewPool.start([this, job]{
+        job->run();
+        QMetaObject::invokeMethod(this, [this, job]{ finishPreview(job); }, Qt::QueuedConnection);
+    });
 }
 
-// Flips the edge of the image such that A,B,C,D looks like ...C,B,A,B,C,D,C,B...
-int Canvas2D::getPixelReflected(int width, int height, int x, int y) {
-    // Task 9: implement this function
-    int newX = (x < 0) ? -x : width - abs(x - width + 1) - 1;
-    int newY = (y < 0) ? -y : height - abs(y - height + 1) - 1;
-    return width * newY + newX;
-}
-
-// Wraps the image such that A,B,C,D looks like ...C,D,A,B,C,D,A,B...
-int Canvas2D::getPixelWrapped(int width, int height, int x, int y) {
-    int newX = (x < 0) ? x + width  : x % width;
-    int newY = (y < 0) ? y + height : y % height;
-    return width * newY + newX;
-}
-
-std::uint8_t Canvas2D::rgbaToGray(const RGBA &pixel) {
-    // Task 3: Calculate and return the gray value of the
-    //         pixel using its RGB components.
-    // Note: We are returning an std::uint8_t, because it is 1 byte
-    //       and can store values from 0-255!
-    std::uint8_t R = pixel.r;
-    std::uint8_t G = pixel.g;
-    std::uint8_t B = pixel.b;
-    std::uint8_t Y = 0.299 * R + 0.587 * G + 0.114 * B;
-
-    return Y;
-}
-
-void Canvas2D::filterGray() {
-    for (int row = 0; row < m_height; ++row) {
-        for (int col = 0; col < m_width; ++col) {
-            size_t currentIndex = m_width * row + col;
-            RGBA &currentPixel = m_data[currentIndex];
-
-            // Task 2: call rgbaToGray()
-            std::uint8_t gray_currentPixel = rgbaToGray(currentPixel);
-
-            // Task 4: Update currentPixel's color
-            currentPixel.r = gray_currentPixel;
-            currentPixel.g = gray_currentPixel;
-            currentPixel.b = gray_currentPixel;
-        }
+void Canvas2D::finishPreview(const std::shared_ptr<FilterJob> &job) {
+    m_previewWork = std::move(job->work);
+    if (job != m_previewJob) {
+        return;
     }
-}
-
-
-std::vector<float> Canvas2D::filterBlur(int radius){
-    float sigma = radius / 3.f;
-    if (sigma < 1.0){
-        sigma = 1.0;
-    }
-    int filter_size = radius * 2 + 1;
-    std::vector<float> gaussianfilter;
-    gaussianfilter.assign(filter_size, 0.0);
-    float sum = 0;
-    for (int x = 0; x < filter_size; x++){
-        float x1 = sqrt(2 * M_PI * (sigma * sigma));
-        float x2 = exp(-(pow((x - radius), 2)/(2*(sigma*sigma))));
-        gaussianfilter[x] = (1/x1)*x2;
-        sum = sum + (1/x1)*x2;
-    }
-
-    for (int i = 0; i < gaussianfilter.size(); i++){
-        gaussianfilter[i] = gaussianfilter[i] / sum;
-    }
-
-    return gaussianfilter;
-
-}
-
-std::vector<RGBA> Canvas2D::filterSobel(float sensitivity){
-    filterGray();
-    sobel_result.assign(m_data.size(), SOBELIMG{0.0, 0.0, 0.0, 255});
-    std::vector<RGBA> d = m_data;
-    std::vector<float> G_x1 = {1.0, 2.0, 1.0};
-    std::vector<float> G_x2 = {-1.0, 0.0, 1.0};
-    std::vector<float> G_y1 = {-1.0, 0.0, 1.0};
-    std::vector<float> G_y2 = {1.0, 2.0, 1.0};
-
-    std::vector<RGBA> image1;
-    image1 = d;
-    std::vector<RGBA> image2;
-    image2 = d;
-    convolve(image1, m_width, m_height, G_x1, 1, 3, false);
-    convolve(image1, m_width, m_height, G_x2, 3, 1, true);
-    std::vector<SOBELIMG> fin_image1;
-    fin_image1 = sobel_result;
-
-    convolve(image2, m_width, m_height, G_y1, 1, 3, false);
-    convolve(image2, m_width, m_height, G_x2, 3, 1, true);
-    std::vector<SOBELIMG> fin_image2;
-    fin_image2 = sobel_result;
-
-    std::vector<RGBA> G;
-    G.assign(m_data.size(), RGBA{0, 0, 0, 255});
-    for (int i = 0; i < m_data.size(); i++){
-        float gradientMagnitude = sqrt(pow(fin_image1[i].r, 2) + pow(fin_image2[i].r, 2) ) * sensitivity;
-        uint8_t gradientValue = static_cast<uint8_t>(std::clamp(gradientMagnitude, 0.0f, 255.0f));
-        G[i].r = gradientValue;
-        G[i].g = gradientValue;
-        G[i].b = gradientValue;
+    m_previewJob.reset();
+
+    m_previewImage = QImage(reinterpret_cast<const uchar*>(job->pixels.data()), job->width, job->height,
+                            QImage::Format_RGBX8888).copy();
+    // Scaling and rotation change the size of the result; show it at the
+    // size Apply would produce
+    if (job->step.filterType == FILTER_SCALE) {
+        fitToContent(static_cast<int>(std::lround(m_width * job->step.a)), static_cast<int>(std::lround(m_height * job->step.b)));
+    } else if (job->step.filterType == FILTER_ROTATION) {
+        int width, height;
+        rotatedSize(m_width, m_height, job->step.a, width, height);
+        fitToContent(width, height);
+    } else {
+        fitToContent(m_width, m_height);
     }
-
-    return G;
-
+    update();
 }
 
-std::vector<RGBA> Canvas2D::filterScaling(std::vector<RGBA> &data, int width, int height, float x, float y, bool horizontal){
-    newWidth = round(width * x);
-    newHeight = round(height * y);
-    std::vector<RGBA> result;
-    result.assign(newWidth * newHeight, RGBA{0, 0, 0, 255});
-    for (int i = 0; i < newWidth; i++){
-        for (int j = 0; j < newHeight; j++){
-            if (horizontal){
-                result[j * newWidth + i] = h_prime(data, width, height, i, x, j, true);
-            }else{
-                result[j * newWidth + i] = h_prime(data, width, height, j, y, i, false);
-            }
-        }
+/**
+ * @brief Cancels any pending preview and shows the canvas itself again
+ */
+void Canvas2D::clearPreview() {
+    m_previewTimer.stop();
+    if (m_previewJob) {
+        m_previewJob->control.cancel();
+        m_previewJob.reset();
     }
-    return result;
-
-}
-
-RGBA Canvas2D::h_prime(std::vector<RGBA> &data, int width, int height, int k, double a, int fixed, bool horizontal){
-    double sumR = 0, sumG = 0, sumB = 0, weights_sum = 0;
-    int left, right;
-
-    double center = k/a + (1-a)/(2*a);
-    double radius = (a > 1) ? 1 : 1/a;
-
-    left = std::ceil(center - radius);
-    right = std::floor(center + radius);
-
-    for (int i = left; i <= right; i++){
-        int index = horizontal ? (fixed * width + i)  : (i * width + fixed) ;
-//        if (index >= 0 && index < data.size()){
-//            sumR +=  g(i - center, a) * data[index].r;
-//            sumG +=  g(i - center, a) * data[index].g;
-//            sumB +=  g(i - center, a) * data[index].b;
-//        }else{
-            if (horizontal){
-                sumR +=  g(i - center, a) * data[getPixelRepeated(width, height, i, fixed)].r;
-                sumG +=  g(i - center, a) * data[getPixelRepeated(width, height, i, fixed)].g;
-                sumB +=  g(i - center, a) * data[getPixelRepeated(width, height, i, fixed)].b;
-
-            }else{
-                sumR +=  g(i - center, a) * data[getPixelRepeated(width, height, fixed, i)].r;
-                sumG +=  g(i - center, a) * data[getPixelRepeated(width, height, fixed, i)].g;
-                sumB +=  g(i - center, a) * data[getPixelRepeated(width, height, fixed, i)].b;
-
-            }
-//        }
-        weights_sum += g(i - center, a);
+    if (!m_previewImage.isNull()) {
+        m_previewImage = QImage();
+        fitToContent(m_width, m_height);
+        update();
     }
-
-    RGBA result;
-    result.r = static_cast<std::uint8_t> (sumR / weights_sum);
-    result.g = static_cast<std::uint8_t> (sumG / weights_sum);
-    result.b = static_cast<std::uint8_t> (sumB / weights_sum);
-    return result;
 }
 
-double Canvas2D::g(double x, double a){
-    double radius;
-    radius = a < 1 ? 1.0/a : 1.0;
-    if ((x < -radius) || (x > radius)) {
-        return 0;
-    } else {
-        return (1 - fabs(x)/radius) / radius;
+/**
+ * @brief Draws the preview, if one is shown, scaled to the widget; otherwise
+ * the canvas at the zoom level. Only the exposed part is painted, so the cost
+ * follows the visible area rather than the canvas size.
+ */
+void Canvas2D::paintEvent(QPaintEvent *event) {
+    QPainter painter(this);
+    if (!m_previewImage.isNull()) {
+        TRACE_SPAN("paintPreview");
+        painter.drawImage(rect(), m_previewImage);
+        return;
     }
+    TRACE_SPAN("paintCanvas");
+    int level = displayLevel();
+    const RGBA *data = level == 0 ? pixels().data() : pyramid().pixels(level).data();
+    int width = level == 0 ? m_width : m_pyramid.width(level);
+    int height = level == 0 ? m_height : m_pyramid.height(level);
+    // The QImage only borrows the pixels for the duration of the draw
+    QImage image(reinterpret_cast<const uchar*>(data), width, height, QImage::Format_RGBX8888);
+    painter.drawImage(event->rect(), image, event->rect());
 }
 
-void Canvas2D::convolve(std::vector<RGBA> &data, int width, int height, const std::vector<float> &kernel, int k_width, int k_height, bool sobel) {
-    std::vector<RGBA> result;
-    result.assign(data.size(), RGBA{0, 0, 0, 255});
-
-    for (int r = 0; r < height; r++) {
-        for (int c = 0; c < width; c++) {
-            size_t centerIndex = r * width + c;
-
-            float redAcc = 0.0;
-            float greenAcc = 0.0;
-            float blueAcc = 0.0;
-
-
-            for (int i = 0; i < k_height; i++){
-                for (int j = 0; j < k_width; j++){
-                    int central_kernel_index = (k_width - 1) / 2;
-
-                    int flipped_i = k_height - 1 - i;
-                    int flipped_j = k_width - 1 - j;
-
-                    int curr_data_i = (i - central_kernel_index) + r;
-                    int curr_data_j = (j - central_kernel_index) + c;
-
-                    if (sobel){
-                            redAcc +=  (float) temp_sobel_image[getPixelReflected(width, height, curr_data_j, curr_data_i)].r * kernel[flipped_i * k_width + flipped_j];
-                            greenAcc += (float) temp_sobel_image[getPixelReflected(width, height, curr_data_j, curr_data_i)].g * kernel[flipped_i * k_width + flipped_j];
-                            blueAcc += (float) temp_sobel_image[getPixelReflected(width, height, curr_data_j, curr_data_i)].b * kernel[flipped_i * k_width + flipped_j];
-                    }else{
-                            redAcc +=  (float) data[getPixelReflected(width, height, curr_data_j, curr_data_i)].r * kernel[flipped_i * k_width + flipped_j];
-                            greenAcc += (float) data[getPixelReflected(width, height, curr_data_j, curr_data_i)].g * kernel[flipped_i * k_width + flipped_j];
-                            blueAcc += (float) data[getPixelReflected(width, height, curr_data_j, curr_data_i)].b * kernel[flipped_i * k_width + flipped_j];
-                    }
-                }
-            }
-            if (sobel){
-                sobel_result[centerIndex].r = redAcc;
-                sobel_result[centerIndex].g = greenAcc;
-                sobel_result[centerIndex].b = blueAcc;
-            }else{
-                temp_sobel_image[centerIndex].r = redAcc;
-                temp_sobel_image[centerIndex].g = greenAcc;
-                temp_sobel_image[centerIndex].b = blueAcc;
-                result[centerIndex].r = std::max(0.0f, std::min(255.0f, redAcc));
-                result[centerIndex].g = std::max(0.0f, std::min(255.0f, greenAcc));
-                result[centerIndex].b = std::max(0.0f, std::min(255.0f, blueAcc));
-                result[centerIndex].a = 255;
-
-            }
-
-        }
-    }
-    for (int index = 0; index < data.size(); index++){
-        data[index] = result[index];
+/**
+ * @brief Called when any of the parameters in the UI are modified.
+ */
+void Canvas2D::settingsChanged() {
+    // this saves your UI settings locally to load next time you run the program,
+    // off the UI thread once the controls have settled
+    settings.saveSettingsLater();
+    // The brush is set up from the settings when the next stroke starts
+    // (see mouseDown()), so a change mid-stroke leaves that stroke alone
+    if (m_previewEnabled) {
+        m_previewTimer.start();
     }
 
+    // TODO: fill in what you need to do when brush or filter parameters change
 }
 
-
 /**
  * @brief These functions are called when the mouse is clicked and dragged on the canvas
  */
 void Canvas2D::mouseDown(int x, int y) {
     // Brush TODO
+    clearPreview();
+    detachFromSource();
     m_isDown = true;
-    int radius = settings.brushRadius;
-
-    if (settings.brushType == BRUSH_CONSTANT){
-        initConstantMask(radius);
-    }else if (settings.brushType == BRUSH_LINEAR){
-        initLinearMask(radius);
-    }else if (settings.brushType == BRUSH_QUADRATIC){
-        initQuadraticMask(radius);
-    }else if (settings.brushType == BRUSH_SMUDGE){
-        initLinearMask(radius);
-        initSmudgeMask(x, y, settings.brushRadius);
+    m_strokeBrush = currentBrushSettings();
+    configureBrush(m_brush, m_strokeBrush);
+    beginStroke(m_brush, m_strokeBrush, m_data, m_width, m_height, x, y);
+    if (m_recording){
+        m_recording->strokes.push_back({m_strokeBrush, {}});
     }
     mouseDragged(x, y);
 }
@@ -551,18 +483,40 @@ void Canvas2D::mouseDown(int x, int y) {
 void Canvas2D::mouseDragged(int x, int y) {
     // Brush TODO
     if (m_isDown == true){
-
-        if (settings.brushType == BRUSH_SMUDGE){
-            brushSmudge(x, y);
-            initSmudgeMask(x, y, settings.brushRadius);
-        }else{
-            brush(x, y);
+        brushDab(m_brush, m_strokeBrush, m_data, m_width, m_height, x, y);
+        if (m_recording && !m_recording->strokes.empty()){
+            auto elapsed = std::chrono::steady_clock::now() - m_recordingStart;
+            m_recording->strokes.back().points.push_back(
+                {std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), x, y});
         }
+
+        // Only the stamp's square changed: mark those pyramid tiles and
+        // repaint that part of the widget
+        int r = m_brush.radius();
+        m_pyramid.invalidate(x - r, y - r, 2 * r + 1, 2 * r + 1);
+        int scale = 1 << displayLevel();
+        update(QRect((x - r) / scale - 1, (y - r) / scale - 1, (2 * r + 1) / scale + 3, (2 * r + 1) / scale + 3));
     }
-    displayImage();
 }
 
-void Canvas2D::mouseUp(int x, int y) {
+void Canvas2D::mouseUp(int, int) {
     // Brush TODO
     m_isDown = false;
 }
+
+void Canvas2D::startRecording() {
+    m_recording = std::make_unique<StrokeRecording>();
+    m_recording->width = m_width;
+    m_recording->height = m_height;
+    m_recording->base = pixels();
+    m_recordingStart = std::chrono::steady_clock::now();
+}
+
+bool Canvas2D::stopRecording(const QString &file) {
+    std::unique_ptr<StrokeRecording> recording = std::move(m_recording);
+    if (!recording || file.isEmpty()) {
+        return false;
+    }
+    recording->checksum = imageChecksum(pixels());
+    return saveStrokeRecording(QFile::encodeName(file).toStdString(), *recording);
+}
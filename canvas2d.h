@@ -2,44 +2,141 @@
 #define CANVAS2D_H
 
 #include <QLabel>
+#include <QImage>
 #include <QMouseEvent>
+#include <QPaintEvent>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <memory>
 #include "rgba.h"
+#include "brushengine.h"
+#include "imagefilters.h"
+#include "imagesave.h"
+#include "mippyramid.h"
+#include "strokes.h"
+#include "taskpool.h"
 
 class Canvas2D : public QLabel {
     Q_OBJECT
 public:
+    ~Canvas2D();
+
     bool m_isDown = false;
 
     int m_width = 0;
     int m_height = 0;
 
-    int mask_width = 0;
-    int mask_height = 0;
-
 
     void init();
     void clearCanvas();
     bool loadImageFromFile(const QString &file);
-    bool saveImageToFile(const QString &file);
+    bool revertImage(const QString &file);
+    bool saveImageToFile(const QString &file, const SaveOptions &options = {});
     void displayImage();
     void resize(int w, int h);
 
     // This will be called when the settings have changed
     void settingsChanged();
 
-    // Filter TODO: implement
+    // Starts the selected filter on a worker thread and returns immediately.
+    // The result replaces the canvas when it is done; anything painted in the
+    // meantime is overwritten. A filter that is still running is cancelled.
     void filterImage();
+    void cancelFilter();
+    bool filterRunning() const { return m_filterJob != nullptr; }
+
+    // While enabled, filter setting changes show the selected filter applied
+    // to a low-resolution proxy of the canvas. The canvas itself is only
+    // changed by filterImage().
+    void setPreviewEnabled(bool enabled);
+
+    // Shows the canvas at 1/2^level of its size, read from the mip pyramid.
+    // Small canvases stop at the smallest pyramid level. Brush strokes keep
+    // working in canvas coordinates.
+    void setZoomLevel(int level);
+
+    // Records brush strokes from here on, starting from the current canvas,
+    // until stopRecording() saves them to `file` (see StrokeRecording). An
+    // empty file name discards the recording.
+    void startRecording();
+    bool stopRecording(const QString &file);
+    bool recording() const { return m_recording != nullptr; }
+
+    // Hit/miss counters for revertImage(); a hit restores the cached source
+    // without touching the disk, a miss decodes the file again. Plain loads
+    // are not counted. Shown in the Stats tab.
+    int sourceCacheHits() const { return m_sourceCacheHits; }
+    int sourceCacheMisses() const { return m_sourceCacheMisses; }
+
+signals:
+    void filterStarted();
+    void filterProgress(int percent);
+    // `applied` is false if the filter was cancelled
+    void filterFinished(bool applied);
 
 private:
     std::vector<RGBA> m_data;
-    std::vector<float> mask;
-    std::vector<RGBA> smudge_pickup;
-    std::vector<SOBELIMG> temp_sobel_image;
-    std::vector<SOBELIMG> sobel_result;
-    bool sobeled = false;
-    int newWidth = 500;
-    int newHeight = 500;
+
+    // Immutable decoded copy of the last loaded image. While m_sharesSource
+    // is set the canvas shows m_source directly and m_data is stale; the
+    // first write copies it back into m_data (see detachFromSource()).
+    std::shared_ptr<const std::vector<RGBA>> m_source;
+    QString m_sourcePath;
+    int m_sourceWidth = 0;
+    int m_sourceHeight = 0;
+    bool m_sharesSource = false;
+    int m_sourceCacheHits = 0;
+    int m_sourceCacheMisses = 0;
+
+    BrushEngine m_brush;
+    BrushSettings m_strokeBrush;    // of the stroke in progress
+    std::unique_ptr<StrokeRecording> m_recording;
+    std::chrono::steady_clock::time_point m_recordingStart;
+
+    // Filters run on this buffer; it keeps its planes and scratch arena
+    // between calls
+    WorkImage m_work;
+    // Fixed point keeps flat areas at their level where the float path can
+    // darken them by up to two (see FilterPrecision)
+    FilterPrecision m_precision = FilterPrecision::FixedPoint;
+    // Bands of every pass run as tasks on m_taskPool, shared by the filter,
+    // the preview and the pyramid, instead of on threads started per pass
+    TaskPool m_taskPool;
+    Execution m_execution = {true, 0, nullptr, &m_taskPool}; // SIMD, bands sized to the pool
+
+    // The filter in flight, if any. Jobs run one at a time on m_filterPool;
+    // a cancelled job stops at its next row checkpoint.
+    struct FilterJob;
+    std::shared_ptr<FilterJob> m_filterJob;
+    QThreadPool m_filterPool;
+    QTimer m_progressTimer;
+    void finishFilter(const std::shared_ptr<FilterJob> &job);
+
+    // Live preview. m_previewTimer debounces setting changes; each preview
+    // cancels the one before it. The filtered proxy is drawn scaled over the
+    // canvas in paintEvent() until the preview is cleared.
+    bool m_previewEnabled = false;
+    QTimer m_previewTimer;
+    QThreadPool m_previewPool;
+    std::shared_ptr<FilterJob> m_previewJob;
+    WorkImage m_previewWork;
+    QImage m_previewImage;
+
+    void startPreview();
+    void finishPreview(const std::shared_ptr<FilterJob> &job);
+    void clearPreview();
+
+    // Reduced copies of the canvas for zoomed-out display and the preview
+    // proxy. Brush stamps invalidate the tiles under them; the pyramid is
+    // brought up to date lazily, when a reduced level is read.
+    MipPyramid m_pyramid;
+    int m_zoomLevel = 0;
+    int displayLevel() const { return std::min(m_zoomLevel, std::max(0, m_pyramid.levelCount() - 1)); }
+    const MipPyramid &pyramid();
+    void fitToContent(int width, int height);
 
     void mouseDown(int x, int y);
     void mouseDragged(int x, int y);
@@ -51,40 +148,21 @@ private:
     // that you will have to fill in.
     virtual void mousePressEvent(QMouseEvent* event) override {
         auto [x, y] = std::array{ event->position().x(), event->position().y() };
-        mouseDown(static_cast<int>(x), static_cast<int>(y));
+        mouseDown(static_cast<int>(x) << displayLevel(), static_cast<int>(y) << displayLevel());
     }
     virtual void mouseMoveEvent(QMouseEvent* event) override {
         auto [x, y] = std::array{ event->position().x(), event->position().y() };
-        mouseDragged(static_cast<int>(x), static_cast<int>(y));
+        mouseDragged(static_cast<int>(x) << displayLevel(), static_cast<int>(y) << displayLevel());
     }
     virtual void mouseReleaseEvent(QMouseEvent* event) override {
         auto [x, y] = std::array{ event->position().x(), event->position().y() };
-        mouseUp(static_cast<int>(x), static_cast<int>(y));
+        mouseUp(static_cast<int>(x) << displayLevel(), static_cast<int>(y) << displayLevel());
     }
+    virtual void paintEvent(QPaintEvent* event) override;
 
     // TODO: add any member variables or functions you need
-    int posToIndex(int x, int y);
-    int maskToCanvas(int x, int y, int canvas_x, int canvas_y, int radius);
-    void initConstantMask(int radius);
-    void initLinearMask(int radius);
-    void initQuadraticMask(int radius);
-    void initSmudgeMask(int x, int y, int radius);
-    bool checkClearSmudge(int x, int y);
-
-    void brush(int x, int y);
-    void brushSmudge(int x, int y);
-
-    void convolve(std::vector<RGBA> &data, int width, int height, const std::vector<float> &kernel, int k_width, int k_height, bool sobel);
-    std::vector<float> filterBlur(int radius);
-    std::vector<RGBA> filterSobel(float sensitivity);
-    std::vector<RGBA> filterScaling(std::vector<RGBA> &data, int width, int height, float x, float y, bool horizontal);
-    RGBA h_prime(std::vector<RGBA> &data, int width, int height, int k, double a, int fixed, bool horizontal);
-    double g(double x, double a);
-    void filterGray();
-    std::uint8_t rgbaToGray(const RGBA &pixel);
-    int getPixelRepeated(int width, int height, int x, int y);
-    int getPixelReflected(int width, int height, int x, int y);
-    int getPixelWrapped(int width, int height, int x, int y);
+    const std::vector<RGBA> &pixels() const;
+    void detachFromSource();
 };
 
 #endif // CANVAS2D_H
@@ -0,0 +1,38 @@
+#include "colorspace.h"
+#include <cmath>
+
+const std::array<float, 256> &srgbToLinearTable() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t;
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            t[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        return t;
+    }();
+    return table;
+}
+
+const std::array<std::uint16_t, 256> &srgbToLinearStepTable() {
+    static const std::array<std::uint16_t, 256> table = [] {
+        std::array<std::uint16_t, 256> t;
+        for (int i = 0; i < 256; i++) {
+            t[i] = static_cast<std::uint16_t>(srgbToLinearTable()[i] * (kLinearSteps - 1) + 0.5f);
+        }
+        return t;
+    }();
+    return table;
+}
+
+const std::array<std::uint8_t, kLinearSteps> &linearToSrgbTable() {
+    static const std::array<std::uint8_t, kLinearSteps> table = [] {
+        std::array<std::uint8_t, kLinearSteps> t;
+        for (int i = 0; i < kLinearSteps; i++) {
+            double v = static_cast<double>(i) / (kLinearSteps - 1);
+            double s = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1 / 2.4) - 0.055;
+            t[i] = static_cast<std::uint8_t>(std::lround(std::fmin(std::fmax(s, 0.0), 1.0) * 255));
+        }
+        return t;
+    }();
+    return table;
+}
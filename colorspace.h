@@ -0,0 +1,32 @@
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * sRGB <-> linear light through lookup tables, so per-pixel code never calls
+ * pow(). Linear values are floats in [0, 1]; the way back quantizes them to
+ * kLinearSteps levels, which is fine enough that every 8-bit sRGB value
+ * survives a round trip unchanged.
+ */
+
+constexpr int kLinearSteps = 4096;
+
+const std::array<float, 256> &srgbToLinearTable();
+// The same, as the nearest index into linearToSrgbTable(), for integer blends
+const std::array<std::uint16_t, 256> &srgbToLinearStepTable();
+const std::array<std::uint8_t, kLinearSteps> &linearToSrgbTable();
+
+inline float srgbToLinear(std::uint8_t value) {
+    return srgbToLinearTable()[value];
+}
+
+// `value` is clamped to [0, 1]
+inline std::uint8_t linearToSrgb(float value) {
+    int index = static_cast<int>(value * (kLinearSteps - 1) + 0.5f);
+    index = index < 0 ? 0 : (index >= kLinearSteps ? kLinearSteps - 1 : index);
+    return linearToSrgbTable()[index];
+}
+
+#endif // COLORSPACE_H
@@ -0,0 +1,315 @@
+#include "convolve.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CONVOLVE_SSE2 1
+#endif
+
+int reflectIndex(int i, int n) {
+    if (n == 1) {
+        return 0;
+    }
+    while (i < 0 || i >= n) {
+        i = (i < 0) ? -i : 2 * n - i - 2;
+    }
+    return i;
+}
+
+/**
+ * @brief Copies a row into dst with `left` and `right` reflected samples on
+ * either side
+ */
+template <typename T>
+static void padRow(const T *row, T *dst, int width, int left, int right) {
+    for (int x = 0; x < left; x++) {
+        dst[x] = row[reflectIndex(x - left, width)];
+    }
+    std::copy(row, row + width, dst + left);
+    for (int x = 0; x < right; x++) {
+        dst[left + width + x] = row[reflectIndex(width + x, width)];
+    }
+}
+
+// ------ TAP ACCUMULATION ------
+//
+// Both passes reduce to the same inner loop: given one source pointer per
+// tap (shifted copies of a padded row, or the rows above and below), compute
+// acc[x] = sum_j weights[j] * taps[j][x] for one output row.
+
+/**
+ * @brief Accumulation for a tap count known at compile time. The tap loop is
+ * unrolled, so each pixel's sum stays in a register for all taps instead of
+ * going through acc once per tap. Taps are added in order, which keeps float
+ * results identical to the generic loop.
+ */
+template <int Taps, typename In, typename W, typename Acc>
+static void accumulateUnrolled(const In *const *taps, const W *weights, Acc *acc, int width, bool simd) {
+    const In *t[Taps];
+    W w[Taps];
+    for (int j = 0; j < Taps; j++) {
+        t[j] = taps[j];
+        w[j] = weights[j];
+    }
+    auto unroll = [](auto &&body) {
+        [&]<int... J>(std::integer_sequence<int, J...>) {
+            (body.template operator()<J>(), ...);
+        }(std::make_integer_sequence<int, Taps>{});
+    };
+
+    int x = 0;
+#ifdef CONVOLVE_SSE2
+    if (!simd) {
+        // scalar loop below
+    } else if constexpr (std::is_same_v<In, float>) {
+        __m128 wv[Taps];
+        for (int j = 0; j < Taps; j++) {
+            wv[j] = _mm_set1_ps(w[j]);
+        }
+        for (; x + 4 <= width; x += 4) {
+            __m128 sum = _mm_setzero_ps();
+            unroll([&]<int J>() { sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(t[J] + x), wv[J])); });
+            _mm_storeu_ps(acc + x, sum);
+        }
+    } else if constexpr (sizeof(In) == 1 && sizeof(W) == 2) {
+        // Taps are paired as in accumulateGeneric; an odd last tap is paired
+        // with itself at weight zero
+        constexpr int Pairs = (Taps + 1) / 2;
+        const __m128i zero = _mm_setzero_si128();
+        __m128i wv[Pairs];
+        for (int p = 0; p < Pairs; p++) {
+            std::uint16_t lo = static_cast<std::uint16_t>(w[2 * p]);
+            std::uint16_t hi = 2 * p + 1 < Taps ? static_cast<std::uint16_t>(w[2 * p + 1]) : 0;
+            wv[p] = _mm_set1_epi32((hi << 16) | lo);
+        }
+        for (; x + 8 <= width; x += 8) {
+            __m128i sumLo = _mm_setzero_si128();
+            __m128i sumHi = _mm_setzero_si128();
+            [&]<int... P>(std::integer_sequence<int, P...>) {
+                ([&] {
+                    constexpr int B = 2 * P + 1 < Taps ? 2 * P + 1 : 2 * P;
+                    __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(t[2 * P] + x)), zero);
+                    __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(t[B] + x)), zero);
+                    sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), wv[P]));
+                    sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), wv[P]));
+                }(), ...);
+            }(std::make_integer_sequence<int, Pairs>{});
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + x), sumLo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + x + 4), sumHi);
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        Acc sum = 0;
+        unroll([&]<int J>() { sum += static_cast<Acc>(t[J][x]) * w[J]; });
+        acc[x] = sum;
+    }
+}
+
+/**
+ * @brief Accumulation for any tap count, one pass over the row per tap
+ */
+template <typename In, typename W, typename Acc>
+static void accumulateGeneric(const In *const *taps, const W *weights, int count, Acc *acc, int width, bool simd) {
+    std::fill(acc, acc + width, 0);
+    int j = 0;
+#ifdef CONVOLVE_SSE2
+    if (!simd) {
+        // scalar loop below
+    } else if constexpr (sizeof(In) == 1 && sizeof(W) == 2) {
+        // Two taps at a time: interleave their 16-bit samples so one madd
+        // multiplies both and adds the pair into 32-bit lanes
+        const __m128i zero = _mm_setzero_si128();
+        for (; j + 2 <= count; j += 2) {
+            const __m128i w = _mm_set1_epi32((static_cast<std::uint16_t>(weights[j + 1]) << 16) |
+                                             static_cast<std::uint16_t>(weights[j]));
+            const In *a = taps[j];
+            const In *b = taps[j + 1];
+            int x = 0;
+            for (; x + 8 <= width; x += 8) {
+                __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + x)), zero);
+                __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + x)), zero);
+                __m128i *out = reinterpret_cast<__m128i*>(acc + x);
+                _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), _mm_madd_epi16(_mm_unpacklo_epi16(va, vb), w)));
+                _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_madd_epi16(_mm_unpackhi_epi16(va, vb), w)));
+            }
+            for (; x < width; x++) {
+                acc[x] += weights[j] * a[x] + weights[j + 1] * b[x];
+            }
+        }
+    }
+#endif
+    for (; j < count; j++) {
+        const Acc w = weights[j];
+        const In *in = taps[j];
+        for (int x = 0; x < width; x++) {
+            acc[x] += static_cast<Acc>(in[x]) * w;
+        }
+    }
+}
+
+/**
+ * @brief Picks the unrolled kernel for the common odd tap counts (Sobel and
+ * blur radii up to 6) and falls back to the generic loop otherwise
+ */
+template <typename In, typename W, typename Acc>
+static void accumulate(const In *const *taps, const W *weights, int count, Acc *acc, int width, bool simd) {
+    switch (count) {
+    case 1:  accumulateUnrolled<1>(taps, weights, acc, width, simd); break;
+    case 3:  accumulateUnrolled<3>(taps, weights, acc, width, simd); break;
+    case 5:  accumulateUnrolled<5>(taps, weights, acc, width, simd); break;
+    case 7:  accumulateUnrolled<7>(taps, weights, acc, width, simd); break;
+    case 9:  accumulateUnrolled<9>(taps, weights, acc, width, simd); break;
+    case 11: accumulateUnrolled<11>(taps, weights, acc, width, simd); break;
+    case 13: accumulateUnrolled<13>(taps, weights, acc, width, simd); break;
+    default: accumulateGeneric(taps, weights, count, acc, width, simd); break;
+    }
+}
+
+// ------ STORING ------
+
+/**
+ * @brief Converts one accumulated sample to the output type. Float sums are
+ * optionally quantized to a byte value; integer sums are shifted right by
+ * `bits` and, for byte output, clamped to [0, 255].
+ */
+template <typename Out, typename Acc>
+static inline Out narrow(Acc v, bool quantize, int bits) {
+    if constexpr (std::is_floating_point_v<Acc>) {
+        return quantize ? static_cast<float>(static_cast<int>(std::max(0.0f, std::min(255.0f, v)))) : v;
+    } else {
+        v >>= bits;
+        if constexpr (sizeof(Out) == 1) {
+            v = std::max(0, std::min(255, v));
+        }
+        return static_cast<Out>(v);
+    }
+}
+
+/**
+ * @brief Writes an accumulated row to dst
+ * @param shift: dst[x] takes acc[x - shift] (reflected)
+ */
+template <typename Acc, typename Out>
+static void storeRow(const Acc *acc, Out *dst, int width, int shift, bool quantize, int bits) {
+    if (shift != 0) {
+        for (int x = 0; x < width; x++) {
+            dst[x] = narrow<Out>(acc[reflectIndex(x - shift, width)], quantize, bits);
+        }
+        return;
+    }
+    for (int x = 0; x < width; x++) {
+        dst[x] = narrow<Out>(acc[x], quantize, bits);
+    }
+}
+
+// ------ PASSES ------
+
+// Both passes compute each output row independently, so rows are split into
+// bands for the worker threads; every band has its own scratch buffers.
+
+template <typename In, typename Out, typename W, typename Acc>
+static void rowsPass(const In *src, Out *dst, int width, int height, const std::vector<W> &kernel,
+                     int anchor, bool quantize, int bits, const Execution &execution) {
+    int taps = kernel.size();
+    std::vector<W> flipped(kernel.rbegin(), kernel.rend());
+
+    parallelFor(0, height, execution, [&](int begin, int end) {
+        // Each row is copied into a buffer padded with its reflected border so
+        // the taps are plain shifted pointers into it
+        std::vector<In> padded(width + taps - 1);
+        std::vector<const In*> tapRows(taps);
+        std::vector<Acc> acc(width);
+        for (int j = 0; j < taps; j++) {
+            tapRows[j] = padded.data() + j;
+        }
+
+        for (int r = begin; r < end; r++) {
+            const In *row = src + static_cast<size_t>(reflectIndex(r - anchor, height)) * width;
+            padRow(row, padded.data(), width, anchor, taps - 1 - anchor);
+            accumulate(tapRows.data(), flipped.data(), taps, acc.data(), width, execution.simd);
+            storeRow(acc.data(), dst + static_cast<size_t>(r) * width, width, 0, quantize, bits);
+            if (!rowDone(execution)) {
+                return;
+            }
+        }
+    });
+}
+
+template <typename In, typename Out, typename W, typename Acc>
+static void columnsPass(const In *src, Out *dst, int width, int height, const std::vector<W> &kernel,
+                        int anchor, bool quantize, int bits, const Execution &execution) {
+    int taps = kernel.size();
+    std::vector<W> flipped(kernel.rbegin(), kernel.rend());
+
+    parallelFor(0, height, execution, [&](int begin, int end) {
+        std::vector<const In*> tapRows(taps);
+        std::vector<Acc> acc(width);
+
+        // Whole rows are accumulated at once, so every tap streams through
+        // contiguous memory instead of walking down a column
+        for (int r = begin; r < end; r++) {
+            for (int j = 0; j < taps; j++) {
+                tapRows[j] = src + static_cast<size_t>(reflectIndex(r + j - anchor, height)) * width;
+            }
+            accumulate(tapRows.data(), flipped.data(), taps, acc.data(), width, execution.simd);
+            storeRow(acc.data(), dst + static_cast<size_t>(r) * width, width, anchor, quantize, bits);
+            if (!rowDone(execution)) {
+                return;
+            }
+        }
+    });
+}
+
+void convolveRows(const float *src, float *dst, int width, int height,
+                  const std::vector<float> &kernel, int anchor, bool quantize, const Execution &execution) {
+    rowsPass<float, float, float, float>(src, dst, width, height, kernel, anchor, quantize, 0, execution);
+}
+
+void convolveColumns(const float *src, float *dst, int width, int height,
+                     const std::vector<float> &kernel, int anchor, bool quantize, const Execution &execution) {
+    columnsPass<float, float, float, float>(src, dst, width, height, kernel, anchor, quantize, 0, execution);
+}
+
+std::vector<std::int16_t> toFixedPoint(const std::vector<float> &kernel) {
+    std::vector<std::int16_t> fixed(kernel.size());
+    float total = 0.0f;
+    int fixedTotal = 0;
+    size_t largest = 0;
+    for (size_t i = 0; i < kernel.size(); i++) {
+        fixed[i] = static_cast<std::int16_t>(std::lround(kernel[i] * (1 << kFixedPointShift)));
+        total += kernel[i];
+        fixedTotal += fixed[i];
+        if (std::fabs(kernel[i]) > std::fabs(kernel[largest])) {
+            largest = i;
+        }
+    }
+    if (!kernel.empty()) {
+        fixed[largest] += static_cast<int>(std::lround(total * (1 << kFixedPointShift))) - fixedTotal;
+    }
+    return fixed;
+}
+
+void convolveRows(const std::uint8_t *src, std::uint8_t *dst, int width, int height,
+                  const std::vector<std::int16_t> &kernel, int anchor, const Execution &execution) {
+    rowsPass<std::uint8_t, std::uint8_t, std::int16_t, std::int32_t>(src, dst, width, height, kernel, anchor, false, kFixedPointShift, execution);
+}
+
+void convolveColumns(const std::uint8_t *src, std::uint8_t *dst, int width, int height,
+                     const std::vector<std::int16_t> &kernel, int anchor, const Execution &execution) {
+    columnsPass<std::uint8_t, std::uint8_t, std::int16_t, std::int32_t>(src, dst, width, height, kernel, anchor, false, kFixedPointShift, execution);
+}
+
+void convolveColumns(const std::uint8_t *src, std::int16_t *dst, int width, int height,
+                     const std::vector<std::int16_t> &kernel, int anchor, const Execution &execution) {
+    columnsPass<std::uint8_t, std::int16_t, std::int16_t, std::int32_t>(src, dst, width, height, kernel, anchor, false, 0, execution);
+}
+
+void convolveRows(const std::int16_t *src, std::int16_t *dst, int width, int height,
+                  const std::vector<std::int16_t> &kernel, int anchor, const Execution &execution) {
+    rowsPass<std::int16_t, std::int16_t, std::int16_t, std::int32_t>(src, dst, width, height, kernel, anchor, false, 0, execution);
+}
@@ -0,0 +1,64 @@
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+#include <cstdint>
+#include <vector>
+#include "parallel.h"
+
+// Flips the edge of a line such that A,B,C,D looks like ...C,B,A,B,C,D,C,B...
+int reflectIndex(int i, int n);
+
+/**
+ * 1D convolution of every row (convolveRows) or every column
+ * (convolveColumns) of a float plane:
+ *
+ *     rows:    dst(x, y) = sum_j src(x + j - anchor, y - anchor) * kernel[taps - 1 - j]
+ *     columns: dst(x, y) = sum_j src(x - anchor, y + j - anchor) * kernel[taps - 1 - j]
+ *
+ * The kernel is anchored at (anchor, anchor) like a taps x 1 (or 1 x taps) 2D
+ * kernel, so the other axis is shifted by `anchor` as well. The filters rely on
+ * this to reproduce the original RGBA convolve exactly; anchor = 0 gives an
+ * unshifted pass starting at the current pixel.
+ *
+ * Samples outside the plane are reflected. With `quantize` set the result is
+ * clamped to [0, 255] and truncated, as if it had been stored in a byte.
+ * `src` and `dst` must not overlap. `execution` selects SIMD and threading;
+ * the result is the same for every setting. Each finished row is credited to
+ * execution.job, and cancelling the job stops the pass after the current row.
+ */
+void convolveRows(const float *src, float *dst, int width, int height,
+                  const std::vector<float> &kernel, int anchor, bool quantize,
+                  const Execution &execution = {});
+void convolveColumns(const float *src, float *dst, int width, int height,
+                     const std::vector<float> &kernel, int anchor, bool quantize,
+                     const Execution &execution = {});
+
+// Fixed-point kernel weights: 1.0 == 1 << kFixedPointShift
+constexpr int kFixedPointShift = 14;
+
+// Rounds a float kernel to fixed point. The rounding error is folded into the
+// largest tap so the weights sum to exactly the same total as before.
+std::vector<std::int16_t> toFixedPoint(const std::vector<float> &kernel);
+
+/**
+ * Integer versions of the passes above for 8-bit planes: 16-bit weights,
+ * 32-bit accumulators. The sum is shifted right by kFixedPointShift (i.e.
+ * truncated, like the quantized float pass) and clamped to [0, 255].
+ */
+void convolveRows(const std::uint8_t *src, std::uint8_t *dst, int width, int height,
+                  const std::vector<std::int16_t> &kernel, int anchor,
+                  const Execution &execution = {});
+void convolveColumns(const std::uint8_t *src, std::uint8_t *dst, int width, int height,
+                     const std::vector<std::int16_t> &kernel, int anchor,
+                     const Execution &execution = {});
+
+// Unscaled integer kernels producing 16-bit results, for small derivative
+// kernels such as Sobel where the intermediate values exceed a byte
+void convolveColumns(const std::uint8_t *src, std::int16_t *dst, int width, int height,
+                     const std::vector<std::int16_t> &kernel, int anchor,
+                     const Execution &execution = {});
+void convolveRows(const std::int16_t *src, std::int16_t *dst, int width, int height,
+                  const std::vector<std::int16_t> &kernel, int anchor,
+                  const Execution &execution = {});
+
+#endif // CONVOLVE_H
@@ -0,0 +1,41 @@
+#include "imagecompare.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+int ImageDifference::maxChannelDiff() const {
+    return *std::max_element(maxDiff, maxDiff + 4);
+}
+
+bool ImageDifference::within(int tolerance, double minPsnr) const {
+    return sameSize && maxChannelDiff() <= tolerance && psnr >= minPsnr;
+}
+
+ImageDifference compareImages(const std::vector<RGBA> &a, int aWidth, int aHeight,
+                              const std::vector<RGBA> &b, int bWidth, int bHeight, int tolerance) {
+    ImageDifference diff;
+    if (aWidth != bWidth || aHeight != bHeight) {
+        return diff;
+    }
+    diff.sameSize = true;
+
+    size_t n = static_cast<size_t>(aWidth) * aHeight;
+    double squaredError = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        int d[4] = {std::abs(a[i].r - b[i].r), std::abs(a[i].g - b[i].g),
+                    std::abs(a[i].b - b[i].b), std::abs(a[i].a - b[i].a)};
+        bool over = false;
+        for (int c = 0; c < 4; c++) {
+            diff.maxDiff[c] = std::max(diff.maxDiff[c], d[c]);
+            over = over || d[c] > tolerance;
+        }
+        diff.pixelsOver += over;
+        squaredError += d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    }
+
+    double mse = n == 0 ? 0.0 : squaredError / (3.0 * n);
+    diff.psnr = mse == 0.0 ? std::numeric_limits<double>::infinity()
+                           : 10.0 * std::log10(255.0 * 255.0 / mse);
+    return diff;
+}
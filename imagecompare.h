@@ -0,0 +1,29 @@
+#ifndef IMAGECOMPARE_H
+#define IMAGECOMPARE_H
+
+#include <cstddef>
+#include <vector>
+#include "rgba.h"
+
+/**
+ * @struct ImageDifference
+ *
+ * Per-channel comparison of two images of the same size. Alpha is compared
+ * but left out of the PSNR, since the filters always write opaque pixels.
+ */
+struct ImageDifference {
+    bool sameSize = false;
+    int maxDiff[4] = {0, 0, 0, 0};  // largest absolute difference per r, g, b, a
+    size_t pixelsOver = 0;          // pixels with any channel above the tolerance
+    double psnr = 0.0;              // over r, g, b in dB; infinity when identical
+
+    int maxChannelDiff() const;
+    bool identical() const { return sameSize && maxChannelDiff() == 0; }
+    // True if every channel is within `tolerance` and the PSNR is at least `minPsnr`
+    bool within(int tolerance, double minPsnr) const;
+};
+
+ImageDifference compareImages(const std::vector<RGBA> &a, int aWidth, int aHeight,
+                              const std::vector<RGBA> &b, int bWidth, int bHeight, int tolerance = 0);
+
+#endif // IMAGECOMPARE_H
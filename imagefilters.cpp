@@ -0,0 +1,719 @@
+#include "imagefilters.h"
+#include "convolve.h"
+#include "imagestats.h"
+#include "trace.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMAGEFILTERS_SSE2 1
+#endif
+
+std::vector<float> gaussianKernel(int radius){
+    float sigma = radius / 3.f;
+    if (sigma < 1.0){
+        sigma = 1.0;
+    }
+    int filter_size = radius * 2 + 1;
+    std::vector<float> gaussianfilter;
+    gaussianfilter.assign(filter_size, 0.0);
+    float sum = 0;
+    for (int x = 0; x < filter_size; x++){
+        float x1 = sqrt(2 * M_PI * (sigma * sigma));
+        float x2 = exp(-(pow((x - radius), 2)/(2*(sigma*sigma))));
+        gaussianfilter[x] = (1/x1)*x2;
+        sum = sum + (1/x1)*x2;
+    }
+
+    for (size_t i = 0; i < gaussianfilter.size(); i++){
+        gaussianfilter[i] = gaussianfilter[i] / sum;
+    }
+
+    return gaussianfilter;
+}
+
+/**
+ * @brief Separable Gaussian blur. Each pass is quantized to 8 bits and the
+ * passes are anchored like the original RGBA convolve (see convolve.h), so
+ * the output is unchanged.
+ */
+void blurImage(WorkImage &image, int radius, FilterPrecision precision, const Execution &execution){
+    TRACE_SPAN("blur");
+    addRows(execution, 6LL * image.height);
+    std::vector<float> filter = gaussianKernel(radius);
+    if (precision == FilterPrecision::FixedPoint){
+        image.convertTo(kFixedPointLayout);
+        std::vector<std::int16_t> fixed = toFixedPoint(filter);
+        ScratchArena::Frame frame(image.scratch);
+        std::uint8_t *temp = image.scratch.take<std::uint8_t>(image.size());
+        for (int c = 0; c < 3; c++){
+            std::uint8_t *plane = image.planes8[c].data();
+            {
+                TRACE_SPAN("blur.rows");
+                convolveRows(plane, temp, image.width, image.height, fixed, radius, execution);
+            }
+            TRACE_SPAN("blur.columns");
+            convolveColumns(temp, plane, image.width, image.height, fixed, 0, execution);
+        }
+        std::fill(image.planes8[3].begin(), image.planes8[3].end(), 255);
+        return;
+    }
+
+    image.convertTo(kBlurLayout);
+    ScratchArena::Frame frame(image.scratch);
+    float *temp = image.scratch.take<float>(image.size());
+
+    for (int c = 0; c < 3; c++){
+        float *plane = image.planesF[c].data();
+        {
+            TRACE_SPAN("blur.rows");
+            convolveRows(plane, temp, image.width, image.height, filter, radius, true, execution);
+        }
+        TRACE_SPAN("blur.columns");
+        convolveColumns(temp, plane, image.width, image.height, filter, 0, true, execution);
+    }
+    std::fill(image.planes8[3].begin(), image.planes8[3].end(), 255);
+}
+
+/**
+ * @brief Runs body(i) for every pixel index, in row bands across threads
+ */
+template <typename Body>
+static void forEachPixel(const WorkImage &image, const Execution &execution, Body &&body){
+    int w = image.width;
+    parallelFor(0, image.height, execution, [&](int begin, int end){
+        for (int r = begin; r < end; r++){
+            for (size_t i = static_cast<size_t>(r) * w; i < static_cast<size_t>(r + 1) * w; i++){
+                body(i);
+            }
+            if (!rowDone(execution)){
+                return;
+            }
+        }
+    });
+}
+
+static inline std::uint8_t gradientValue(float gx, float gy, float sensitivity){
+    float gradientMagnitude = sqrt(pow(gx, 2) + pow(gy, 2)) * sensitivity;
+    return static_cast<std::uint8_t>(std::clamp(gradientMagnitude, 0.0f, 255.0f));
+}
+
+/**
+ * @brief Integer Sobel on 8-bit planes. The derivative kernels are small
+ * integers, so the 16-bit intermediates are exact and the output matches
+ * the float path.
+ */
+static void edgeDetectFixed(WorkImage &image, float sensitivity, const Execution &execution){
+    image.convertTo(kFixedPointLayout);
+    size_t n = image.size();
+    int w = image.width;
+    int h = image.height;
+    std::uint8_t *gray = image.planes8[0].data();
+    ScratchArena::Frame frame(image.scratch);
+    std::int16_t *temp = image.scratch.take<std::int16_t>(n);
+    std::int16_t *gx = image.scratch.take<std::int16_t>(n);
+    std::int16_t *gy = image.scratch.take<std::int16_t>(n);
+
+    {
+        TRACE_SPAN("edge.gray");
+        parallelFor(0, h, execution, [&](int begin, int end){
+            for (int r = begin; r < end; r++){
+                size_t row = static_cast<size_t>(r) * w;
+                grayPlane(image.planes8[0].data() + row, image.planes8[1].data() + row, image.planes8[2].data() + row, w, gray + row);
+                if (!rowDone(execution)){
+                    return;
+                }
+            }
+        });
+    }
+
+    {
+        TRACE_SPAN("edge.sobel");
+        const std::vector<std::int16_t> smooth = {1, 2, 1};
+        const std::vector<std::int16_t> derivative = {-1, 0, 1};
+        convolveColumns(gray, temp, w, h, smooth, 0, execution);
+        convolveRows(temp, gx, w, h, derivative, 1, execution);
+        convolveColumns(gray, temp, w, h, derivative, 0, execution);
+        convolveRows(temp, gy, w, h, derivative, 1, execution);
+    }
+
+    TRACE_SPAN("edge.magnitude");
+    forEachPixel(image, execution, [&](size_t i){
+        gray[i] = gradientValue(gx[i], gy[i], sensitivity);
+    });
+    std::copy(gray, gray + n, image.planes8[1].begin());
+    std::copy(gray, gray + n, image.planes8[2].begin());
+    std::fill(image.planes8[3].begin(), image.planes8[3].end(), 255);
+}
+
+/**
+ * @brief Sobel edge detection on the grayscale image. The result is written
+ * to all three color planes.
+ */
+void edgeDetectImage(WorkImage &image, float sensitivity, FilterPrecision precision, const Execution &execution){
+    TRACE_SPAN("edge");
+    // gray, four derivative passes and the magnitude
+    addRows(execution, 6LL * image.height);
+    if (precision == FilterPrecision::FixedPoint){
+        edgeDetectFixed(image, sensitivity, execution);
+        return;
+    }
+
+    image.convertTo(kEdgeDetectLayout);
+    size_t n = image.size();
+    int w = image.width;
+    int h = image.height;
+    float *gray = image.planesF[0].data();
+    float *temp = image.planesF[1].data();
+    float *gx = image.planesF[2].data();
+    ScratchArena::Frame frame(image.scratch);
+    float *gy = image.scratch.take<float>(n);
+
+    {
+        TRACE_SPAN("edge.gray");
+        forEachPixel(image, execution, [&](size_t i){
+            gray[i] = rgbaToGray(RGBA{static_cast<std::uint8_t>(image.planesF[0][i]),
+                                      static_cast<std::uint8_t>(image.planesF[1][i]),
+                                      static_cast<std::uint8_t>(image.planesF[2][i])});
+        });
+    }
+
+    {
+        TRACE_SPAN("edge.sobel");
+        const std::vector<float> smooth = {1.0, 2.0, 1.0};
+        const std::vector<float> derivative = {-1.0, 0.0, 1.0};
+        convolveColumns(gray, temp, w, h, smooth, 0, false, execution);
+        convolveRows(temp, gx, w, h, derivative, 1, false, execution);
+        convolveColumns(gray, temp, w, h, derivative, 0, false, execution);
+        convolveRows(temp, gy, w, h, derivative, 1, false, execution);
+    }
+
+    {
+        TRACE_SPAN("edge.magnitude");
+        forEachPixel(image, execution, [&](size_t i){
+            gray[i] = gradientValue(gx[i], gy[i], sensitivity);
+        });
+    }
+    std::copy(gray, gray + n, image.planesF[1].begin());
+    std::copy(gray, gray + n, image.planesF[2].begin());
+    std::fill(image.planes8[3].begin(), image.planes8[3].end(), 255);
+}
+
+// Repeats the pixel on the edge of the image such that A,B,C,D looks like ...A,A,A,B,C,D,D,D...
+static int getPixelRepeated(int width, int height, int x, int y) {
+    int newX = (x < 0) ? 0 : std::min(x, width  - 1);
+    int newY = (y < 0) ? 0 : std::min(y, height - 1);
+    return width * newY + newX;
+}
+
+static double g(double x, double a){
+    double radius;
+    radius = a < 1 ? 1.0/a : 1.0;
+    if ((x < -radius) || (x > radius)) {
+        return 0;
+    } else {
+        return (1 - fabs(x)/radius) / radius;
+    }
+}
+
+static RGBA h_prime(const RGBA *data, int width, int height, int k, double a, int fixed, bool horizontal){
+    double sumR = 0, sumG = 0, sumB = 0, weights_sum = 0;
+    int left, right;
+
+    double center = k/a + (1-a)/(2*a);
+    double radius = (a > 1) ? 1 : 1/a;
+
+    left = std::ceil(center - radius);
+    right = std::floor(center + radius);
+
+    for (int i = left; i <= right; i++){
+        const RGBA &pixel = horizontal ? data[getPixelRepeated(width, height, i, fixed)]
+                                       : data[getPixelRepeated(width, height, fixed, i)];
+        double weight = g(i - center, a);
+        sumR += weight * pixel.r;
+        sumG += weight * pixel.g;
+        sumB += weight * pixel.b;
+        weights_sum += weight;
+    }
+
+    RGBA result;
+    result.r = static_cast<std::uint8_t> (sumR / weights_sum);
+    result.g = static_cast<std::uint8_t> (sumG / weights_sum);
+    result.b = static_cast<std::uint8_t> (sumB / weights_sum);
+    return result;
+}
+
+/**
+ * @brief Resamples the image along one axis with a triangle filter into
+ * `result`, which must hold newWidth x newHeight pixels
+ * @param scale: scale factor along that axis
+ * @param horizontal: true to scale the width, false to scale the height
+ */
+static void scaleAxis(const RGBA *data, int width, int height, float scale, bool horizontal,
+                      RGBA *result, int newWidth, int newHeight, const Execution &execution){
+    int w = newWidth;
+    parallelFor(0, newHeight, execution, [&](int begin, int end){
+        for (int j = begin; j < end; j++){
+            for (int i = 0; i < w; i++){
+                if (horizontal){
+                    result[j * w + i] = h_prime(data, width, height, i, scale, j, true);
+                }else{
+                    result[j * w + i] = h_prime(data, width, height, j, scale, i, false);
+                }
+            }
+            if (!rowDone(execution)){
+                return;
+            }
+        }
+    });
+}
+
+void scaleImage(WorkImage &image, float scaleX, float scaleY, const Execution &execution){
+    TRACE_SPAN("scale");
+    addRows(execution, image.height + static_cast<std::int64_t>(round(image.height * scaleY)));
+    image.convertTo(kScaleLayout);
+    ScratchArena::Frame frame(image.scratch);
+    int w = round(image.width * scaleX);
+    int h = image.height;
+    RGBA *intermediate = image.scratch.take<RGBA>(static_cast<size_t>(w) * h);
+    {
+        TRACE_SPAN("scale.x");
+        scaleAxis(image.pixels.data(), image.width, image.height, scaleX, true, intermediate, w, h, execution);
+    }
+    TRACE_SPAN("scale.y");
+    image.width = w;
+    image.height = round(h * scaleY);
+    // Every pixel is written, so the previous contents need no clearing
+    image.pixels.resize(image.size());
+    scaleAxis(intermediate, w, h, scaleY, false, image.pixels.data(), image.width, image.height, execution);
+}
+
+/**
+ * @brief Sliding-window median (Huang): each channel of a row keeps a window
+ * histogram that moves one column right per pixel, so a pixel costs
+ * 2 * (2 * radius + 1) updates and one rank query rather than a sort of the
+ * whole window
+ */
+void medianImage(WorkImage &image, int radius, const Execution &execution){
+    TRACE_SPAN("median");
+    assert(radius >= 1);
+    image.convertTo(kMedianLayout);
+    if (image.size() == 0){
+        return;
+    }
+    size_t n = image.size();
+    int w = image.width;
+    int h = image.height;
+    int side = 2 * radius + 1;
+    std::uint32_t rank = static_cast<std::uint32_t>(side) * side / 2;
+    ScratchArena::Frame frame(image.scratch);
+    std::uint8_t *out[3];
+    for (int c = 0; c < 3; c++){
+        out[c] = image.scratch.take<std::uint8_t>(n);
+    }
+
+    addRows(execution, h);
+    parallelFor(0, h, execution, [&](int begin, int end){
+        WindowHistogram window;
+        std::vector<const std::uint8_t*> rows(side);
+        for (int y = begin; y < end; y++){
+            for (int c = 0; c < 3; c++){
+                for (int dy = -radius; dy <= radius; dy++){
+                    rows[dy + radius] = image.planes8[c].data() + static_cast<size_t>(std::clamp(y + dy, 0, h - 1)) * w;
+                }
+                window.clear();
+                for (const std::uint8_t *row : rows){
+                    for (int dx = -radius; dx <= radius; dx++){
+                        window.add(row[std::clamp(dx, 0, w - 1)]);
+                    }
+                }
+                std::uint8_t *dst = out[c] + static_cast<size_t>(y) * w;
+                dst[0] = window.valueAtRank(rank);
+                for (int x = 1; x < w; x++){
+                    int leaving = std::max(x - radius - 1, 0);
+                    int entering = std::min(x + radius, w - 1);
+                    for (const std::uint8_t *row : rows){
+                        window.remove(row[leaving]);
+                        window.add(row[entering]);
+                    }
+                    dst[x] = window.valueAtRank(rank);
+                }
+            }
+            if (!rowDone(execution)){
+                return;
+            }
+        }
+    });
+    for (int c = 0; c < 3; c++){
+        std::copy(out[c], out[c] + n, image.planes8[c].begin());
+    }
+}
+
+/**
+ * @brief Moves one plane row by `shift` pixels in place: a memmove of the
+ * part that stays on the row and a memset of the border it uncovers
+ */
+static void shiftRow(std::uint8_t *row, int width, int shift){
+    if (shift > 0){
+        std::uint8_t edge = row[0];
+        int kept = std::max(width - shift, 0);
+        std::memmove(row + width - kept, row, kept);
+        std::memset(row, edge, width - kept);
+    } else if (shift < 0){
+        std::uint8_t edge = row[width - 1];
+        int kept = std::max(width + shift, 0);
+        std::memmove(row, row + width - kept, kept);
+        std::memset(row + kept, edge, width - kept);
+    }
+}
+
+// The bits of channel c (r, g, b, a) in an RGBA pixel read as one word
+static std::uint32_t channelMask(int c){
+    std::uint8_t bytes[4] = {0, 0, 0, 0};
+    bytes[c] = 255;
+    std::uint32_t mask;
+    std::memcpy(&mask, bytes, sizeof(mask));
+    return mask;
+}
+
+/**
+ * @brief Moves each color channel of one interleaved row by its shift in
+ * place. `line` holds two rows of 32-bit pixels: the row is copied to the
+ * first, assembled in the second and copied back. Where every channel's
+ * source is on the row, a pixel is one masked OR of four loads, which the
+ * compiler vectorizes; only the borders clamp per channel.
+ */
+static void shiftInterleavedRow(RGBA *row, std::uint32_t *line, int width, const int shifts[3]){
+    static const std::uint32_t masks[4] = {
+        channelMask(0), channelMask(1), channelMask(2), channelMask(3)
+    };
+    const std::uint32_t *src = line;
+    std::uint32_t *dst = line + width;
+    std::memcpy(line, row, width * sizeof(RGBA));
+    int begin = std::clamp(std::max({shifts[0], shifts[1], shifts[2], 0}), 0, width);
+    int end = std::clamp(width + std::min({shifts[0], shifts[1], shifts[2], 0}), begin, width);
+    auto border = [&](int x){
+        std::uint32_t pixel = src[x] & masks[3];
+        for (int c = 0; c < 3; c++){
+            pixel |= src[std::clamp(x - shifts[c], 0, width - 1)] & masks[c];
+        }
+        dst[x] = pixel;
+    };
+    for (int x = 0; x < begin; x++){
+        border(x);
+    }
+    const std::uint32_t *red = src - shifts[0];
+    const std::uint32_t *green = src - shifts[1];
+    const std::uint32_t *blue = src - shifts[2];
+    for (int x = begin; x < end; x++){
+        dst[x] = (red[x] & masks[0]) | (green[x] & masks[1]) | (blue[x] & masks[2]) | (src[x] & masks[3]);
+    }
+    for (int x = end; x < width; x++){
+        border(x);
+    }
+    std::memcpy(static_cast<void *>(row), dst, width * sizeof(RGBA));
+}
+
+/**
+ * @brief Works in place, row by row, in whichever of the two layouts the
+ * image holds: planes already in Planar8 are shifted with shiftRow(), and
+ * anything else is shifted as interleaved pixels through one scratch row
+ * per band, so the canvas and batch pay no planar round trip
+ */
+void shiftChannels(WorkImage &image, int redShift, int greenShift, int blueShift, const Execution &execution){
+    TRACE_SPAN("chromatic");
+    addRows(execution, image.height);
+    const int shifts[3] = {redShift, greenShift, blueShift};
+    int w = image.width;
+    if (image.layout == ImageLayout::Planar8){
+        image.convertTo(ImageLayout::Planar8);
+        parallelFor(0, image.height, execution, [&](int begin, int end){
+            for (int r = begin; r < end; r++){
+                size_t row = static_cast<size_t>(r) * w;
+                for (int c = 0; c < 3; c++){
+                    shiftRow(image.planes8[c].data() + row, w, shifts[c]);
+                }
+                if (!rowDone(execution)){
+                    return;
+                }
+            }
+        });
+        return;
+    }
+
+    image.convertTo(kChromaticLayout);
+    parallelFor(0, image.height, execution, [&](int begin, int end){
+        std::vector<std::uint32_t> line(2 * static_cast<size_t>(w));
+        for (int r = begin; r < end; r++){
+            shiftInterleavedRow(image.pixels.data() + static_cast<size_t>(r) * w, line.data(), w, shifts);
+            if (!rowDone(execution)){
+                return;
+            }
+        }
+    });
+}
+
+// Side of the square destination tiles rotation works in. The source
+// pixels one tile reads lie in a rotated square of the same size, so they
+// stay in cache whatever the angle and reads never walk the whole image.
+static constexpr int kRotateTile = 64;
+
+/**
+ * @brief The angle as a number of clockwise quarter turns in [0, 4), or -1
+ * if it is not a multiple of 90 degrees
+ */
+static int quarterTurns(float degrees){
+    double turns = degrees / 90.0;
+    double rounded = std::round(turns);
+    if (std::abs(turns - rounded) > 1e-6){
+        return -1;
+    }
+    return ((static_cast<long long>(rounded) % 4) + 4) % 4;
+}
+
+void rotatedSize(int width, int height, float degrees, int &rotatedWidth, int &rotatedHeight){
+    int turns = quarterTurns(degrees);
+    if (turns >= 0){
+        rotatedWidth = turns % 2 ? height : width;
+        rotatedHeight = turns % 2 ? width : height;
+        return;
+    }
+    double radians = degrees * M_PI / 180;
+    double c = std::abs(std::cos(radians));
+    double s = std::abs(std::sin(radians));
+    // The epsilon keeps rounding noise from adding a column or row
+    rotatedWidth = static_cast<int>(std::ceil(width * c + height * s - 1e-6));
+    rotatedHeight = static_cast<int>(std::ceil(width * s + height * c - 1e-6));
+}
+
+/**
+ * @brief Runs body(x0, x1, y0, y1) for every kRotateTile square of a
+ * width x height destination, a row of tiles per parallel item
+ */
+template <typename Body>
+static void forEachTile(int width, int height, const Execution &execution, Body &&body){
+    int tileRows = (height + kRotateTile - 1) / kRotateTile;
+    addRows(execution, tileRows);
+    parallelFor(0, tileRows, execution, [&](int begin, int end){
+        for (int ty = begin; ty < end; ty++){
+            int y0 = ty * kRotateTile;
+            int y1 = std::min(y0 + kRotateTile, height);
+            for (int x0 = 0; x0 < width; x0 += kRotateTile){
+                body(x0, std::min(x0 + kRotateTile, width), y0, y1);
+            }
+            if (!rowDone(execution)){
+                return;
+            }
+        }
+    }, 1);
+}
+
+/**
+ * @brief Quarter turns as tiled transposes: each destination tile gathers
+ * from one source tile, so the column-wise reads of a 90 degree turn stay
+ * within kRotateTile rows of the source
+ */
+static void rotateQuarters(const RGBA *src, int w, int h, int turns, RGBA *dst, int dw, int dh, const Execution &execution){
+    forEachTile(dw, dh, execution, [&](int x0, int x1, int y0, int y1){
+        for (int y = y0; y < y1; y++){
+            RGBA *out = dst + static_cast<size_t>(y) * dw;
+            if (turns == 1){
+                for (int x = x0; x < x1; x++){
+                    out[x] = src[static_cast<size_t>(h - 1 - x) * w + y];
+                }
+            } else if (turns == 2){
+                const RGBA *in = src + static_cast<size_t>(h - 1 - y) * w + (w - 1);
+                for (int x = x0; x < x1; x++){
+                    out[x] = in[-x];
+                }
+            } else {
+                for (int x = x0; x < x1; x++){
+                    out[x] = src[static_cast<size_t>(x) * w + (w - 1 - y)];
+                }
+            }
+        }
+    });
+}
+
+/**
+ * @brief Bilinear interpolation with weights in 256ths: down the two
+ * columns, rounded, then across. The SSE2 version rounds at the same
+ * points, so both give identical results.
+ */
+static inline RGBA bilinear(const RGBA &topLeft, const RGBA &topRight, const RGBA &bottomLeft, const RGBA &bottomRight,
+                            int fx, int fy){
+    auto lerp = [&](int tl, int tr, int bl, int br){
+        int left = (tl * (256 - fy) + bl * fy + 128) >> 8;
+        int right = (tr * (256 - fy) + br * fy + 128) >> 8;
+        return static_cast<std::uint8_t>((left * (256 - fx) + right * fx + 128) >> 8);
+    };
+    return RGBA{lerp(topLeft.r, topRight.r, bottomLeft.r, bottomRight.r),
+                lerp(topLeft.g, topRight.g, bottomLeft.g, bottomRight.g),
+                lerp(topLeft.b, topRight.b, bottomLeft.b, bottomRight.b),
+                lerp(topLeft.a, topRight.a, bottomLeft.a, bottomRight.a)};
+}
+
+#ifdef IMAGEFILTERS_SSE2
+// bilinear() of the pixel pairs top[0..1] and bottom[0..1], all channels of
+// both columns in one vector of 16-bit lanes
+static inline RGBA bilinearSse2(const RGBA *top, const RGBA *bottom, int fx, int fy){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    __m128i upper = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(top)), zero);
+    __m128i lower = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bottom)), zero);
+    // Products and sums stay below 65536, so 16-bit lanes hold them
+    // unsigned
+    __m128i columns = _mm_add_epi16(_mm_mullo_epi16(upper, _mm_set1_epi16(static_cast<short>(256 - fy))),
+                                    _mm_mullo_epi16(lower, _mm_set1_epi16(static_cast<short>(fy))));
+    columns = _mm_srli_epi16(_mm_add_epi16(columns, half), 8);
+    __m128i weights = _mm_set_epi16(fx, fx, fx, fx, 256 - fx, 256 - fx, 256 - fx, 256 - fx);
+    __m128i weighted = _mm_mullo_epi16(columns, weights);
+    __m128i sum = _mm_add_epi16(weighted, _mm_srli_si128(weighted, 8));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, half), 8);
+    // r in the low byte, as the lanes were loaded
+    auto packed = static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+    return RGBA{static_cast<std::uint8_t>(packed), static_cast<std::uint8_t>(packed >> 8),
+                static_cast<std::uint8_t>(packed >> 16), static_cast<std::uint8_t>(packed >> 24)};
+}
+#endif
+
+/**
+ * @brief `count` samples along a line through the source, starting at
+ * (sx, sy) in 16.16 fixed point. Samples within half a pixel of the source
+ * edge are still taken (with the edge repeated), which keeps the rotated
+ * border from thinning; farther out the result is transparent. Everything
+ * comes in by value: `out` is written through uint8 members, which may
+ * alias anything reached through a reference and would force reloads.
+ */
+static void sampleLine(const RGBA *src, int w, int h, std::int64_t sx, std::int64_t sy,
+                       std::int64_t stepX, std::int64_t stepY, RGBA *out, int count, bool simd){
+    const std::int64_t half = 1 << 15;
+    const std::int64_t maxX = (static_cast<std::int64_t>(w - 1) << 16) + half;
+    const std::int64_t maxY = (static_cast<std::int64_t>(h - 1) << 16) + half;
+    for (int x = 0; x < count; x++, sx += stepX, sy += stepY){
+        if (sx < -half || sx >= maxX || sy < -half || sy >= maxY){
+            out[x] = RGBA{0, 0, 0, 0};
+            continue;
+        }
+        int ix = static_cast<int>(sx >> 16);
+        int iy = static_cast<int>(sy >> 16);
+        int fx = static_cast<int>((sx >> 8) & 0xFF);
+        int fy = static_cast<int>((sy >> 8) & 0xFF);
+        if (static_cast<unsigned>(ix) < static_cast<unsigned>(w - 1) && static_cast<unsigned>(iy) < static_cast<unsigned>(h - 1)){
+            const RGBA *p = src + static_cast<size_t>(iy) * w + ix;
+#ifdef IMAGEFILTERS_SSE2
+            if (simd){
+                out[x] = bilinearSse2(p, p + w, fx, fy);
+                continue;
+            }
+#endif
+            out[x] = bilinear(p[0], p[1], p[w], p[w + 1], fx, fy);
+            continue;
+        }
+        // Near the edge: arithmetic shifts floor the half pixel before the
+        // first column and row to -1, which the clamps send back to 0
+        int xa = std::clamp(ix, 0, w - 1);
+        int xb = std::min(ix + 1, w - 1);
+        const RGBA *top = src + static_cast<size_t>(std::clamp(iy, 0, h - 1)) * w;
+        const RGBA *bottom = src + static_cast<size_t>(std::min(iy + 1, h - 1)) * w;
+        out[x] = bilinear(top[xa], top[xb], bottom[xa], bottom[xb], fx, fy);
+    }
+}
+
+/**
+ * @brief Inverse mapping, tile by tile. Source coordinates are computed
+ * exactly at the start of each tile row and stepped across it in fixed
+ * point, so there is no trigonometry per pixel and no drift across the
+ * image.
+ */
+static void rotateBilinear(const RGBA *src, int w, int h, float degrees, RGBA *dst, int dw, int dh,
+                           const Execution &execution){
+    double radians = degrees * M_PI / 180;
+    double c = std::cos(radians);
+    double s = std::sin(radians);
+    double srcCenterX = (w - 1) / 2.0;
+    double srcCenterY = (h - 1) / 2.0;
+    double dstCenterX = (dw - 1) / 2.0;
+    double dstCenterY = (dh - 1) / 2.0;
+    const double one = 1 << 16;
+    std::int64_t stepX = std::llround(c * one);
+    std::int64_t stepY = std::llround(-s * one);
+
+    forEachTile(dw, dh, execution, [&](int x0, int x1, int y0, int y1){
+        for (int y = y0; y < y1; y++){
+            double dx = x0 - dstCenterX;
+            double dy = y - dstCenterY;
+            std::int64_t sx = std::llround((c * dx + s * dy + srcCenterX) * one);
+            std::int64_t sy = std::llround((-s * dx + c * dy + srcCenterY) * one);
+            sampleLine(src, w, h, sx, sy, stepX, stepY, dst + static_cast<size_t>(y) * dw + x0, x1 - x0, execution.simd);
+        }
+    });
+}
+
+void rotateImage(WorkImage &image, float degrees, const Execution &execution){
+    TRACE_SPAN("rotate");
+    int turns = quarterTurns(degrees);
+    if (turns == 0){
+        return;
+    }
+    image.convertTo(kRotateLayout);
+    int w = image.width;
+    int h = image.height;
+    int dw, dh;
+    rotatedSize(w, h, degrees, dw, dh);
+
+    // The source is copied to scratch so the result can be written straight
+    // into the image's own pixels. Swapping the vector out instead would
+    // save the copy but allocate, and fault in, a fresh full-size buffer on
+    // every call, where the arena's block is reused.
+    ScratchArena::Frame frame(image.scratch);
+    RGBA *src = image.scratch.take<RGBA>(image.size());
+    std::copy(image.pixels.begin(), image.pixels.end(), src);
+    image.width = dw;
+    image.height = dh;
+    // Every pixel is written, so the previous contents need no clearing
+    image.pixels.resize(image.size());
+    if (turns > 0){
+        rotateQuarters(src, w, h, turns, image.pixels.data(), dw, dh, execution);
+    } else {
+        rotateBilinear(src, w, h, degrees, image.pixels.data(), dw, dh, execution);
+    }
+}
+
+void applyPointOp(WorkImage &image, const PointOp &op){
+    image.pendingOps.append(op);
+}
+
+void toneMapImage(WorkImage &image, float gamma, bool nonLinear, const Execution &execution){
+    TRACE_SPAN("toneMap");
+    if (nonLinear){
+        applyPointOp(image, PointOp::gamma(gamma));
+        return;
+    }
+
+    // The stretch depends on the current values, earlier pending ops
+    // included; the statistics see those without applying them
+    ImageStats stats = computeImageStats(image, execution);
+    if (image.size() == 0){
+        return;
+    }
+    int low = 255;
+    int high = 0;
+    for (int c = 0; c < 3; c++){
+        low = std::min(low, stats.channels[c].percentile(kAutoLevelsClip));
+        high = std::max(high, stats.channels[c].percentile(1 - kAutoLevelsClip));
+    }
+    applyPointOp(image, PointOp::levels(low, high));
+}
+
+/**
+ * @brief BT.601 luma, truncated. Uses the precomputed products, which give
+ * exactly the values of the original 0.299 * R + 0.587 * G + 0.114 * B.
+ */
+std::uint8_t rgbaToGray(const RGBA &pixel) {
+    const std::array<std::array<double, 256>, 3> &p = grayProducts();
+    return static_cast<std::uint8_t>(p[0][pixel.r] + p[1][pixel.g] + p[2][pixel.b]);
+}
@@ -0,0 +1,73 @@
+#ifndef IMAGEFILTERS_H
+#define IMAGEFILTERS_H
+
+#include <cstdint>
+#include <vector>
+#include "parallel.h"
+#include "pointops.h"
+#include "workimage.h"
+
+// Arithmetic used by the convolution filters. FixedPoint works on 8-bit
+// planes with 16-bit weights; edge detection is exact and blur stays within
+// two levels of the float path. The fixed kernel sums to exactly 1 << 14, but
+// the float one sums to just under 1, so each truncated float pass can lose
+// a level on flat areas (white can blur to 253) that fixed point
+// keeps.
+enum class FilterPrecision {
+    Float,
+    FixedPoint
+};
+
+// Layout each filter works in. The filter converts the image on entry, so a
+// caller that already holds the image in this layout pays no conversion.
+constexpr ImageLayout kBlurLayout = ImageLayout::PlanarFloat;
+constexpr ImageLayout kEdgeDetectLayout = ImageLayout::PlanarFloat;
+constexpr ImageLayout kFixedPointLayout = ImageLayout::Planar8;
+constexpr ImageLayout kScaleLayout = ImageLayout::Interleaved;
+constexpr ImageLayout kMedianLayout = ImageLayout::Planar8;
+constexpr ImageLayout kChromaticLayout = ImageLayout::Interleaved;  // Planar8 images stay planar
+constexpr ImageLayout kRotateLayout = ImageLayout::Interleaved;
+
+// Normalized 1D Gaussian with 2 * radius + 1 taps
+std::vector<float> gaussianKernel(int radius);
+
+// `execution` picks SIMD and threading and never changes the result. With
+// execution.job set, the filters announce their work in rows, report each
+// finished row and return early once the job is cancelled, leaving the image
+// contents unspecified.
+void blurImage(WorkImage &image, int radius, FilterPrecision precision = FilterPrecision::Float,
+               const Execution &execution = {});
+void edgeDetectImage(WorkImage &image, float sensitivity, FilterPrecision precision = FilterPrecision::Float,
+                     const Execution &execution = {});
+void scaleImage(WorkImage &image, float scaleX, float scaleY, const Execution &execution = {});
+// Median of each channel over a (2 * radius + 1) square, edges repeated;
+// alpha is kept. radius must be at least 1, as the UI allows
+void medianImage(WorkImage &image, int radius, const Execution &execution = {});
+// FILTER_CHROMATIC: moves each color channel right by its shift in pixels
+// (left if negative), repeating the edge pixel into the uncovered border;
+// alpha is kept
+void shiftChannels(WorkImage &image, int redShift, int greenShift, int blueShift, const Execution &execution = {});
+
+// FILTER_ROTATION: rotates clockwise by `degrees` around the center onto
+// the bounding box of the result, transparent black outside the source.
+// Multiples of 90 degrees move pixels exactly; other angles are sampled
+// bilinearly.
+void rotateImage(WorkImage &image, float degrees, const Execution &execution = {});
+// Size rotateImage() gives a width x height image
+void rotatedSize(int width, int height, float degrees, int &rotatedWidth, int &rotatedHeight);
+
+// Queues a point op on the image; it is applied during the image's next
+// layout conversion (see WorkImage), not here
+void applyPointOp(WorkImage &image, const PointOp &op);
+// Fraction of the darkest and of the brightest values auto-levels ignores,
+// so a few outliers do not pin the range
+constexpr double kAutoLevelsClip = 0.001;
+
+// FILTER_MAPPING: 255 * (v / 255)^gamma if nonLinear, otherwise auto-levels,
+// a linear stretch of the channel values onto [0, 255] with kAutoLevelsClip
+// of each channel clipped at either end
+void toneMapImage(WorkImage &image, float gamma, bool nonLinear, const Execution &execution = {});
+
+std::uint8_t rgbaToGray(const RGBA &pixel);
+
+#endif // IMAGEFILTERS_H
@@ -0,0 +1,48 @@
+#include "imagesave.h"
+#include "trace.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageWriter>
+#include <algorithm>
+#include <iostream>
+
+SaveOptions fastSaveOptions() {
+    SaveOptions options;
+    options.pngCompression = 1;
+    options.jpegQuality = 90;
+    return options;
+}
+
+/**
+ * @brief Qt's PNG writer takes the zlib level through setQuality(), as
+ * level = (100 - quality) * 9 / 91. Returns a quality that maps back onto
+ * `level`.
+ */
+static int pngQualityForLevel(int level) {
+    return 100 - (level * 91 + 8) / 9;
+}
+
+bool saveImage(const QString &path, const RGBA *pixels, int width, int height, const SaveOptions &options) {
+    TRACE_SPAN("saveImage.encode");
+    QByteArray format = options.format.isEmpty() ? QFileInfo(path).suffix().toLower().toLatin1() : options.format.toLower();
+    if (format == kRawImageSuffix) {
+        return saveRawImage(QFile::encodeName(path).toStdString(), pixels, width, height, options.rawCompression);
+    }
+
+    // RGBX8888 stores bytes as R,G,B,X which is exactly the layout of RGBA
+    QImage image(reinterpret_cast<const uchar*>(pixels), width, height, QImage::Format_RGBX8888);
+    QImageWriter writer(path, format);
+    if (format == "png") {
+        if (options.pngCompression >= 0) {
+            writer.setQuality(pngQualityForLevel(std::min(options.pngCompression, 9)));
+        }
+    } else if (options.jpegQuality >= 0) {
+        writer.setQuality(std::min(options.jpegQuality, 100));
+    }
+    if (!writer.write(image)) {
+        std::cout<<"Failed to save "<<path.toStdString()<<": "<<writer.errorString().toStdString()<<std::endl;
+        return false;
+    }
+    return true;
+}
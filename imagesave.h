@@ -0,0 +1,31 @@
+#ifndef IMAGESAVE_H
+#define IMAGESAVE_H
+
+#include <QByteArray>
+#include <QString>
+#include "rawimage.h"
+#include "rgba.h"
+
+/**
+ * How an image is encoded. Compression levels trade encode time for file
+ * size; they never change the decoded pixels except for JPEG quality.
+ */
+struct SaveOptions {
+    QByteArray format;      // "png", "jpg", ... ; empty = from the file suffix
+    int pngCompression = -1;  // zlib level 0 (store) to 9 (smallest), -1 = Qt's default
+    int jpegQuality = -1;     // 0 to 100, -1 = Qt's default (75)
+    RawCompression rawCompression = RawCompression::None;  // for .rimg
+};
+
+// Throughput over size: zlib level 1 and JPEG quality 90. Used by the batch
+// runner, where encoding is the slowest stage.
+SaveOptions fastSaveOptions();
+
+/**
+ * Saves interleaved pixels (alpha dropped, as the canvas always did) without
+ * copying them into a QImage first. .rimg files, or format "rimg", go
+ * through saveRawImage(). Failures are reported on stdout.
+ */
+bool saveImage(const QString &path, const RGBA *pixels, int width, int height, const SaveOptions &options = {});
+
+#endif // IMAGESAVE_H
@@ -0,0 +1,232 @@
+#include "imagestats.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+// Pixels converted and counted at a time on the generic path, as in
+// WorkImage::convertMapped()
+static constexpr size_t kBlock = 1024;
+
+// Sub-histograms per channel. Consecutive pixels count into different
+// copies, so runs of equal values (flat areas, clipped highlights) do not
+// wait on the previous increment of the same counter.
+static constexpr int kCopies = 4;
+
+/**
+ * @brief The bins one band counts into, 16 KB, so they stay in L1 next to
+ * the pixels streaming through
+ */
+struct BandBins {
+    std::uint32_t bins[kCopies][4][256] = {};
+};
+
+std::uint64_t ChannelStats::count() const {
+    std::uint64_t total = 0;
+    for (std::uint64_t n : histogram) {
+        total += n;
+    }
+    return total;
+}
+
+int ChannelStats::min() const {
+    return percentile(0);
+}
+
+int ChannelStats::max() const {
+    return percentile(1);
+}
+
+double ChannelStats::mean() const {
+    std::uint64_t total = 0;
+    std::uint64_t sum = 0;
+    for (int v = 0; v < 256; v++) {
+        total += histogram[v];
+        sum += histogram[v] * v;
+    }
+    return total ? static_cast<double>(sum) / total : 0;
+}
+
+int ChannelStats::percentile(double fraction) const {
+    std::uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(std::clamp(fraction, 0.0, 1.0) * (total - 1));
+    std::uint64_t seen = 0;
+    for (int v = 0; v < 256; v++) {
+        seen += histogram[v];
+        if (seen > rank) {
+            return v;
+        }
+    }
+    return 255;
+}
+
+std::uint8_t WindowHistogram::valueAtRank(std::uint32_t rank) const {
+    int coarse = 0;
+    while (rank >= m_coarse[coarse]) {
+        rank -= m_coarse[coarse];
+        coarse++;
+    }
+    int v = coarse * 16;
+    while (rank >= m_fine[v]) {
+        rank -= m_fine[v];
+        v++;
+    }
+    return static_cast<std::uint8_t>(v);
+}
+
+/**
+ * @brief Counts four planes, all channels of a pixel at once like
+ * countInterleaved(); one plane at a time would put the copies of a channel
+ * 4 KB apart, where their accesses alias
+ */
+static void countPlanes(const std::uint8_t *const planes[4], size_t count, BandBins &bins) {
+    size_t i = 0;
+    for (; i + kCopies <= count; i += kCopies) {
+        for (int k = 0; k < kCopies; k++) {
+            for (int c = 0; c < 4; c++) {
+                bins.bins[k][c][planes[c][i + k]]++;
+            }
+        }
+    }
+    for (; i < count; i++) {
+        for (int c = 0; c < 4; c++) {
+            bins.bins[0][c][planes[c][i]]++;
+        }
+    }
+}
+
+/**
+ * @brief Counts interleaved pixels straight from memory, all four channels
+ * per pixel. Histogram increments are scatters, which SSE2 has no
+ * instruction for; instead each pixel is loaded as one 32-bit word and split
+ * with shifts (r in the low byte, as everywhere the layout is assumed
+ * little-endian), which beats four byte loads by about a quarter.
+ */
+static void countInterleaved(const RGBA *pixels, size_t count, BandBins &bins) {
+    auto countPixel = [&](const RGBA &pixel, std::uint32_t (&bins)[4][256]) {
+        std::uint32_t word;
+        std::memcpy(&word, &pixel, sizeof(word));
+        bins[0][word & 0xFF]++;
+        bins[1][(word >> 8) & 0xFF]++;
+        bins[2][(word >> 16) & 0xFF]++;
+        bins[3][word >> 24]++;
+    };
+    size_t i = 0;
+    for (; i + kCopies <= count; i += kCopies) {
+        for (int k = 0; k < kCopies; k++) {
+            countPixel(pixels[i + k], bins.bins[k]);
+        }
+    }
+    for (; i < count; i++) {
+        countPixel(pixels[i], bins.bins[0]);
+    }
+}
+
+/**
+ * @brief Runs count(first, n, bins) over every row in pieces of at most
+ * kBlock pixels, with bins private to each band, and adds the bands up
+ */
+template <typename Count>
+static ImageStats collect(int width, int height, const Execution &execution, Count &&count) {
+    ImageStats stats;
+    std::mutex mutex;
+    addRows(execution, height);
+    parallelFor(0, height, execution, [&](int begin, int end) {
+        BandBins bins;
+        for (int r = begin; r < end; r++) {
+            size_t row = static_cast<size_t>(r) * width;
+            for (size_t x = 0; x < static_cast<size_t>(width); x += kBlock) {
+                count(row + x, std::min(kBlock, width - x), bins);
+            }
+            if (!rowDone(execution)) {
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int c = 0; c < 4; c++) {
+            for (int v = 0; v < 256; v++) {
+                std::uint64_t n = 0;
+                for (int k = 0; k < kCopies; k++) {
+                    n += bins.bins[k][c][v];
+                }
+                stats.channels[c].histogram[v] += n;
+            }
+        }
+    });
+    return stats;
+}
+
+ImageStats computeImageStats(const RGBA *pixels, int width, int height, const Execution &execution) {
+    TRACE_SPAN("imageStats");
+    return collect(width, height, execution, [&](size_t first, size_t count, BandBins &bins) {
+        countInterleaved(pixels + first, count, bins);
+    });
+}
+
+/**
+ * @brief Interleaved and Planar8 images are counted in place. Pending ops
+ * without a gray conversion map each value on its own, so the raw counts
+ * are moved to the mapped bins afterwards; otherwise, and for float planes,
+ * the values go through 8-bit planes a block at a time, the same way
+ * convertTo() would produce them.
+ */
+ImageStats computeImageStats(const WorkImage &image, const Execution &execution) {
+    const PointOp &ops = image.pendingOps;
+    bool mapped = !ops.isIdentity();
+    bool inPlace = image.layout != ImageLayout::PlanarFloat && (!mapped || ops.isPerChannel());
+
+    ImageStats stats;
+    if (inPlace && image.layout == ImageLayout::Interleaved) {
+        stats = computeImageStats(image.pixels.data(), image.width, image.height, execution);
+    } else if (inPlace) {
+        TRACE_SPAN("imageStats");
+        stats = collect(image.width, image.height, execution, [&](size_t first, size_t count, BandBins &bins) {
+            const std::uint8_t *planes[4];
+            for (int c = 0; c < 4; c++) {
+                planes[c] = image.planes8[c].data() + first;
+            }
+            countPlanes(planes, count, bins);
+        });
+    } else {
+        TRACE_SPAN("imageStats.blocks");
+        return collect(image.width, image.height, execution, [&](size_t first, size_t count, BandBins &bins) {
+            alignas(16) std::uint8_t block[4][kBlock];
+            const std::uint8_t *in[4] = {block[0], block[1], block[2], block[3]};
+            if (image.layout == ImageLayout::Interleaved) {
+                deinterleave(image.pixels.data() + first, count, block[0], block[1], block[2], block[3]);
+            } else {
+                for (int c = 0; c < 3; c++) {
+                    if (image.layout == ImageLayout::Planar8) {
+                        in[c] = image.planes8[c].data() + first;
+                    } else {
+                        narrowToByte(image.planesF[c].data() + first, count, block[c]);
+                    }
+                }
+                in[3] = image.planes8[3].data() + first;
+            }
+            if (mapped) {
+                ops.apply(in[0], in[1], in[2], count, block[0], block[1], block[2]);
+                in[0] = block[0];
+                in[1] = block[1];
+                in[2] = block[2];
+            }
+            countPlanes(in, count, bins);
+        });
+    }
+
+    if (mapped) {
+        for (int c = 0; c < 3; c++) {
+            const PointOp::Table &table = ops.channelTable(c);
+            std::array<std::uint64_t, 256> raw = stats.channels[c].histogram;
+            stats.channels[c].histogram.fill(0);
+            for (int v = 0; v < 256; v++) {
+                stats.channels[c].histogram[table[v]] += raw[v];
+            }
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,78 @@
+#ifndef IMAGESTATS_H
+#define IMAGESTATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "parallel.h"
+#include "rgba.h"
+#include "workimage.h"
+
+/**
+ * @struct ChannelStats
+ *
+ * Histogram of one 8-bit channel and the statistics read off it. All of
+ * them are exact; percentiles return one of the values present.
+ */
+struct ChannelStats {
+    std::array<std::uint64_t, 256> histogram{};
+
+    std::uint64_t count() const;
+    // 0 for an empty histogram
+    int min() const;
+    int max() const;
+    double mean() const;
+    // The value at `fraction` of the way through the sorted values, so 0 is
+    // min(), 0.5 the median and 1 max()
+    int percentile(double fraction) const;
+};
+
+/**
+ * @struct ImageStats
+ *
+ * Statistics of every channel of an image, r, g, b and a
+ */
+struct ImageStats {
+    ChannelStats channels[4];
+};
+
+// Histograms of all four channels in one pass over the image, in any
+// layout. Pending point ops are applied to the counted values (but not to
+// the image), so the result describes the image as the next conversion will
+// leave it; float planes are truncated to 8 bits. Each band counts into its
+// own bins, merged once at the end. With execution.job set, reports one row
+// at a time; the result is incomplete if the job is cancelled.
+ImageStats computeImageStats(const WorkImage &image, const Execution &execution = {});
+ImageStats computeImageStats(const RGBA *pixels, int width, int height, const Execution &execution = {});
+
+/**
+ * @class WindowHistogram
+ *
+ * Histogram of a sliding window of 8-bit values, for rank filters such as
+ * the median: values enter and leave one at a time, and a rank query scans
+ * 16 coarse bins of 16 values and then at most 16 fine ones.
+ */
+class WindowHistogram {
+public:
+    void clear() {
+        m_fine.fill(0);
+        m_coarse.fill(0);
+    }
+    void add(std::uint8_t v) {
+        m_fine[v]++;
+        m_coarse[v >> 4]++;
+    }
+    void remove(std::uint8_t v) {
+        m_fine[v]--;
+        m_coarse[v >> 4]--;
+    }
+    // The value with `rank` smaller values (counting duplicates) before it
+    // in the window; rank must be less than the window size
+    std::uint8_t valueAtRank(std::uint32_t rank) const;
+
+private:
+    std::array<std::uint32_t, 256> m_fine{};
+    std::array<std::uint32_t, 16> m_coarse{};
+};
+
+#endif // IMAGESTATS_H
@@ -0,0 +1,39 @@
+#ifndef JOBCONTROL_H
+#define JOBCONTROL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @class JobControl
+ *
+ * Shared between a long-running operation and whoever started it. The
+ * starter may cancel at any time; the operation polls cancelled() at its
+ * checkpoints (once per row in the filters) and stops early, leaving its
+ * output unspecified. Progress is counted in work units: the operation
+ * announces what it is about to do with addWork() and reports finished
+ * units with completeWork(). All members are thread safe.
+ */
+class JobControl {
+public:
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+    void addWork(std::int64_t units) { m_total.fetch_add(units, std::memory_order_relaxed); }
+    void completeWork(std::int64_t units) { m_done.fetch_add(units, std::memory_order_relaxed); }
+
+    // Fraction of the announced work that is done, in [0, 1]
+    float progress() const {
+        std::int64_t total = m_total.load(std::memory_order_relaxed);
+        std::int64_t done = m_done.load(std::memory_order_relaxed);
+        return total > 0 ? std::min(1.0f, static_cast<float>(done) / total) : 0.0f;
+    }
+
+private:
+    std::atomic<bool> m_cancelled{false};
+    std::atomic<std::int64_t> m_total{0};
+    std::atomic<std::int64_t> m_done{0};
+};
+
+#endif // JOBCONTROL_H
@@ -1,5 +1,6 @@
 #include "mainwindow.h"
 #include "settings.h"
+#include "trace.h"
 
 #include <QHBoxLayout>
 #include <QVBoxLayout>
@@ -9,6 +10,8 @@
 #include <QTabWidget>
 #include <QScrollArea>
 #include <QCheckBox>
+#include <QFontDatabase>
+#include <cstdio>
 #include <iostream>
 
 MainWindow::MainWindow()
@@ -46,6 +49,11 @@ MainWindow::MainWindow()
     filterLayout->setAlignment(Qt::AlignTop);
     filterGroup->setLayout(filterLayout);
 
+    QWidget *statsGroup = new QWidget();
+    QVBoxLayout *statsLayout = new QVBoxLayout();
+    statsLayout->setAlignment(Qt::AlignTop);
+    statsGroup->setLayout(statsLayout);
+
     QScrollArea *controlsScroll = new QScrollArea();
     QTabWidget *tabs = new QTabWidget();
     controlsScroll->setWidget(tabs);
@@ -53,6 +61,7 @@ MainWindow::MainWindow()
 
     tabs->addTab(brushGroup, "Brush");
     tabs->addTab(filterGroup, "Filter");
+    tabs->addTab(statsGroup, "Stats");
 
     vLayout->addWidget(controlsScroll);
 
@@ -79,6 +88,9 @@ MainWindow::MainWindow()
     addRadioButton(brushLayout, "Custom", settings.brushType == BRUSH_CUSTOM, [this]{ setBrushType(BRUSH_CUSTOM); });
     addCheckBox(brushLayout, "Fix alpha blending", settings.fixAlphaBlending, [this](bool value){ setBoolVal(settings.fixAlphaBlending, value); });
 
+    // strokes painted while checked are saved for headless replay (bench --replay)
+    addCheckBox(brushLayout, "Record strokes", false, [this](bool value){ onRecordToggled(value); });
+
     // clearing canvas
     addPushButton(brushLayout, "Clear canvas", &MainWindow::onClearButtonClick);
 
@@ -118,10 +130,42 @@ MainWindow::MainWindow()
     addSpinBox(filterLayout, "radius", 1, 100, 1, settings.bilateralRadius, [this](int value){ setIntVal(settings.bilateralRadius, value); });
 
     // filter push buttons
+    addCheckBox(filterLayout, "Live preview", false, [this](bool value){ m_canvas->setPreviewEnabled(value); });
     addPushButton(filterLayout, "Load Image", &MainWindow::onUploadButtonClick);
-    addPushButton(filterLayout, "Apply Filter", &MainWindow::onFilterButtonClick);
+    m_filterButton = addPushButton(filterLayout, "Apply Filter", &MainWindow::onFilterButtonClick);
+    m_cancelFilterButton = addPushButton(filterLayout, "Cancel Filter", &MainWindow::onCancelFilterButtonClick);
+    m_cancelFilterButton->setEnabled(false);
+    m_filterProgress = new QProgressBar();
+    m_filterProgress->setRange(0, 100);
+    m_filterProgress->setValue(0);
+    filterLayout->addWidget(m_filterProgress);
+    connect(m_canvas, &Canvas2D::filterStarted, this, &MainWindow::onFilterStarted);
+    connect(m_canvas, &Canvas2D::filterProgress, m_filterProgress, &QProgressBar::setValue);
+    connect(m_canvas, &Canvas2D::filterFinished, this, &MainWindow::onFilterFinished);
     addPushButton(filterLayout, "Revert Image", &MainWindow::onRevertButtonClick);
     addPushButton(filterLayout, "Save Image", &MainWindow::onSaveButtonClick);
+
+    // zoomed-out views are read from the canvas mip pyramid
+    addHeading(filterLayout, "View");
+    addSpinBox(filterLayout, "zoom out (1/2^n)", 0, 6, 1, 0, [this](int value){ m_canvas->setZoomLevel(value); });
+
+    // encoder settings for both Save Image buttons; the format comes from the file name
+    addHeading(filterLayout, "Save");
+    addSpinBox(filterLayout, "PNG compression", 0, 9, 1, settings.pngCompression, [this](int value){ setIntVal(settings.pngCompression, value); });
+    addSpinBox(filterLayout, "JPEG quality", 0, 100, 1, settings.jpegQuality, [this](int value){ setIntVal(settings.jpegQuality, value); });
+
+    // revert cache counters, and timing of filter stages, brush stamps and
+    // display uploads
+    addHeading(statsLayout, "Timing");
+    addCheckBox(statsLayout, "Enable tracing", tracingEnabled(), [this](bool value){ onTracingToggled(value); });
+    m_statsLabel = new QLabel();
+    m_statsLabel->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    m_statsLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    statsLayout->addWidget(m_statsLabel);
+    addPushButton(statsLayout, "Refresh", &MainWindow::refreshStats);
+    addPushButton(statsLayout, "Clear", &MainWindow::onClearStatsClick);
+    addPushButton(statsLayout, "Export Chrome Trace", &MainWindow::onExportTraceClick);
+    refreshStats();
 }
 
 /**
@@ -189,10 +233,11 @@ void MainWindow::addDoubleSpinBox(QBoxLayout *layout, QString text, double min,
             this, function);
 }
 
-void MainWindow::addPushButton(QBoxLayout *layout, QString text, auto function) {
+QPushButton *MainWindow::addPushButton(QBoxLayout *layout, QString text, auto function) {
     QPushButton *button = new QPushButton(text);
     layout->addWidget(button);
     connect(button, &QPushButton::clicked, this, function);
+    return button;
 }
 
 void MainWindow::addCheckBox(QBoxLayout *layout, QString text, bool val, auto function) {
@@ -248,13 +293,37 @@ void MainWindow::onFilterButtonClick() {
     m_canvas->filterImage();
 }
 
+void MainWindow::onCancelFilterButtonClick() {
+    m_canvas->cancelFilter();
+}
+
+/**
+ * @brief Filters run in the background; one at a time, so "Apply Filter"
+ * is disabled until the running one finishes or is cancelled
+ */
+void MainWindow::onFilterStarted() {
+    m_filterButton->setEnabled(false);
+    m_cancelFilterButton->setEnabled(true);
+    m_filterProgress->setValue(0);
+}
+
+void MainWindow::onFilterFinished(bool applied) {
+    m_filterButton->setEnabled(true);
+    m_cancelFilterButton->setEnabled(false);
+    if (!applied) {
+        m_filterProgress->setValue(0);
+    }
+    refreshStats();
+}
+
 void MainWindow::onRevertButtonClick() {
-    m_canvas->loadImageFromFile(settings.imagePath);
+    m_canvas->revertImage(settings.imagePath);
+    refreshStats();
 }
 
 void MainWindow::onUploadButtonClick() {
     // Get new image path selected by user
-    QString file = QFileDialog::getOpenFileName(this, tr("Open Image"), QDir::homePath(), tr("Image Files (*.png *.jpg *.jpeg)"));
+    QString file = QFileDialog::getOpenFileName(this, tr("Open Image"), QDir::homePath(), tr("Image Files (*.png *.jpg *.jpeg *.rimg)"));
     if (file.isEmpty()) { return; }
     settings.imagePath = file;
 
@@ -266,9 +335,62 @@ void MainWindow::onUploadButtonClick() {
 
 void MainWindow::onSaveButtonClick() {
     // Get new image path selected by user
-    QString file = QFileDialog::getSaveFileName(this, tr("Save Image"), QDir::currentPath(), tr("Image Files (*.png *.jpg *.jpeg)"));
+    QString file = QFileDialog::getSaveFileName(this, tr("Save Image"), QDir::currentPath(), tr("Image Files (*.png *.jpg *.jpeg);;Raw Image (*.rimg)"));
     if (file.isEmpty()) { return; }
 
     // Save image
-    m_canvas->saveImageToFile(file);
+    SaveOptions options;
+    options.pngCompression = settings.pngCompression;
+    options.jpegQuality = settings.jpegQuality;
+    m_canvas->saveImageToFile(file, options);
+}
+
+void MainWindow::onRecordToggled(bool enabled) {
+    if (enabled) {
+        m_canvas->startRecording();
+        return;
+    }
+    QString file = QFileDialog::getSaveFileName(this, tr("Save Stroke Recording"), QDir::currentPath(), tr("Stroke Recording (*.strokes)"));
+    m_canvas->stopRecording(file);
+}
+
+
+// ------ TRACING ------
+
+void MainWindow::onTracingToggled(bool enabled) {
+    setTracingEnabled(enabled);
+    refreshStats();
+}
+
+/**
+ * @brief Shows how reverts were served, then count, total, mean and max time
+ * per span name, slowest first
+ */
+void MainWindow::refreshStats() {
+    QString text = QString::asprintf("reverts: %d from cache, %d decoded\n\n",
+                                     m_canvas->sourceCacheHits(), m_canvas->sourceCacheMisses());
+    if (!tracingEnabled() && traceEvents().empty()) {
+        m_statsLabel->setText(text + "Tracing is off.");
+        return;
+    }
+    text += QString::asprintf("%-22s %6s %10s %9s %9s\n", "span", "count", "total ms", "mean ms", "max ms");
+    for (const TraceStats &stats : traceSummary()) {
+        text += QString::asprintf("%-22s %6d %10.2f %9.3f %9.3f\n",
+                                  stats.name, stats.count, stats.totalMs, stats.meanMs, stats.maxMs);
+    }
+    m_statsLabel->setText(text);
+}
+
+void MainWindow::onClearStatsClick() {
+    clearTrace();
+    refreshStats();
+}
+
+void MainWindow::onExportTraceClick() {
+    QString file = QFileDialog::getSaveFileName(this, tr("Export Trace"), QDir::currentPath(), tr("Chrome Trace (*.json)"));
+    if (file.isEmpty()) { return; }
+
+    if (!exportChromeTrace(file.toStdString())) {
+        std::cout<<"Failed to export trace"<<std::endl;
+    }
 }
@@ -10,6 +10,7 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QBoxLayout>
+#include <QProgressBar>
 
 #include "canvas2d.h"
 
@@ -23,13 +24,17 @@ public:
 private:
     void setupCanvas2D();
     Canvas2D *m_canvas;
+    QLabel *m_statsLabel;
+    QPushButton *m_filterButton;
+    QPushButton *m_cancelFilterButton;
+    QProgressBar *m_filterProgress;
 
     void addHeading(QBoxLayout *layout, QString text);
     void addLabel(QBoxLayout *layout, QString text);
     void addRadioButton(QBoxLayout *layout, QString text, bool value, auto function);
     void addSpinBox(QBoxLayout *layout, QString text, int min, int max, int step, int val, auto function);
     void addDoubleSpinBox(QBoxLayout *layout, QString text, double min, double max, double step, double val, int decimal, auto function);
-    void addPushButton(QBoxLayout *layout, QString text, auto function);
+    QPushButton *addPushButton(QBoxLayout *layout, QString text, auto function);
     void addCheckBox(QBoxLayout *layout, QString text, bool value, auto function);
 
 private slots:
@@ -43,8 +48,17 @@ private slots:
 
     void onClearButtonClick();
     void onFilterButtonClick();
+    void onCancelFilterButtonClick();
+    void onFilterStarted();
+    void onFilterFinished(bool applied);
     void onRevertButtonClick();
     void onUploadButtonClick();
     void onSaveButtonClick();
+    void onRecordToggled(bool enabled);
+
+    void onTracingToggled(bool enabled);
+    void refreshStats();
+    void onClearStatsClick();
+    void onExportTraceClick();
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,120 @@
+#include "mippyramid.h"
+#include "trace.h"
+#include <algorithm>
+
+void MipPyramid::reset(int width, int height) {
+    int levels = 1;
+    for (int side = std::max(width, height); side > kSmallestSide; side = (side + 1) / 2) {
+        levels++;
+    }
+    m_levels.resize(levels);
+
+    for (int l = 0; l < levels; l++) {
+        Level &level = m_levels[l];
+        level.width = l == 0 ? width : (m_levels[l - 1].width + 1) / 2;
+        level.height = l == 0 ? height : (m_levels[l - 1].height + 1) / 2;
+        level.tilesX = (level.width + kTileSize - 1) / kTileSize;
+        level.tilesY = (level.height + kTileSize - 1) / kTileSize;
+        if (l > 0) {
+            level.pixels.resize(static_cast<size_t>(level.width) * level.height);
+        }
+    }
+    invalidateAll();
+}
+
+void MipPyramid::invalidateAll() {
+    for (Level &level : m_levels) {
+        level.dirtyTiles.assign(static_cast<size_t>(level.tilesX) * level.tilesY, 1);
+    }
+    m_dirty = true;
+}
+
+void MipPyramid::invalidate(int x, int y, int w, int h) {
+    if (m_levels.empty()) {
+        return;
+    }
+    Level &base = m_levels[0];
+    int x0 = std::max(0, x);
+    int y0 = std::max(0, y);
+    int x1 = std::min(base.width, x + w);
+    int y1 = std::min(base.height, y + h);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    for (int ty = y0 / kTileSize; ty <= (y1 - 1) / kTileSize; ty++) {
+        for (int tx = x0 / kTileSize; tx <= (x1 - 1) / kTileSize; tx++) {
+            base.dirtyTiles[ty * base.tilesX + tx] = 1;
+        }
+    }
+    m_dirty = true;
+}
+
+/**
+ * @brief Averages the 2x2 blocks of src under dst pixels [x0, x1) x [y0, y1).
+ * Blocks cut off by an odd source edge average the pixels that exist.
+ */
+static void halveRegion(const RGBA *src, int srcWidth, int srcHeight, RGBA *dst, int dstWidth,
+                        int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        const RGBA *top = src + static_cast<size_t>(2 * y) * srcWidth;
+        const RGBA *bottom = 2 * y + 1 < srcHeight ? top + srcWidth : top;
+        RGBA *out = dst + static_cast<size_t>(y) * dstWidth;
+        for (int x = x0; x < x1; x++) {
+            int left = 2 * x;
+            int right = std::min(left + 1, srcWidth - 1);
+            out[x] = RGBA{static_cast<std::uint8_t>((top[left].r + top[right].r + bottom[left].r + bottom[right].r + 2) / 4),
+                          static_cast<std::uint8_t>((top[left].g + top[right].g + bottom[left].g + bottom[right].g + 2) / 4),
+                          static_cast<std::uint8_t>((top[left].b + top[right].b + bottom[left].b + bottom[right].b + 2) / 4),
+                          255};
+        }
+    }
+}
+
+void MipPyramid::update(const RGBA *base, const Execution &execution) {
+    if (!m_dirty) {
+        return;
+    }
+    TRACE_SPAN("mipUpdate");
+    const int half = kTileSize / 2;
+
+    for (int l = 1; l < levelCount(); l++) {
+        Level &below = m_levels[l - 1];
+        Level &level = m_levels[l];
+        const RGBA *src = l == 1 ? base : below.pixels.data();
+
+        // Tile (tx, ty) below covers a half x half block of this level
+        parallelFor(0, below.tilesY, execution, [&](int begin, int end) {
+            for (int ty = begin; ty < end; ty++) {
+                for (int tx = 0; tx < below.tilesX; tx++) {
+                    if (!below.dirtyTiles[ty * below.tilesX + tx]) {
+                        continue;
+                    }
+                    halveRegion(src, below.width, below.height, level.pixels.data(), level.width,
+                                tx * half, ty * half,
+                                std::min(level.width, (tx + 1) * half), std::min(level.height, (ty + 1) * half));
+                }
+            }
+        }, 1);
+
+        for (int ty = 0; ty < below.tilesY; ty++) {
+            for (int tx = 0; tx < below.tilesX; tx++) {
+                std::uint8_t &flag = below.dirtyTiles[ty * below.tilesX + tx];
+                if (flag) {
+                    level.dirtyTiles[(ty / 2) * level.tilesX + tx / 2] = 1;
+                    flag = 0;
+                }
+            }
+        }
+    }
+    std::fill(m_levels.back().dirtyTiles.begin(), m_levels.back().dirtyTiles.end(), 0);
+    m_dirty = false;
+}
+
+int MipPyramid::levelAtMost(int maxSide) const {
+    for (int l = 0; l < levelCount(); l++) {
+        if (std::max(m_levels[l].width, m_levels[l].height) <= maxSide) {
+            return l;
+        }
+    }
+    return levelCount() - 1;
+}
@@ -0,0 +1,58 @@
+#ifndef MIPPYRAMID_H
+#define MIPPYRAMID_H
+
+#include <cstdint>
+#include <vector>
+#include "parallel.h"
+#include "rgba.h"
+
+/**
+ * @class MipPyramid
+ *
+ * Successive 2x2 box reductions of an image, for zoomed-out display and
+ * previews. Level 0 is the image itself and is not stored; level n is
+ * ceil(width / 2^n) x ceil(height / 2^n), down to a longest side of
+ * kSmallestSide or less.
+ *
+ * Each level is split into kTileSize x kTileSize tiles with a dirty flag.
+ * Writes to the image are reported with invalidate(), and update() then
+ * recomputes only the tiles above the changed area, level by level.
+ */
+class MipPyramid {
+public:
+    static constexpr int kTileSize = 64;
+    static constexpr int kSmallestSide = 32;
+
+    // Sizes the levels for a width x height image and marks everything dirty
+    void reset(int width, int height);
+    // Marks a rectangle of level 0 as changed; clipped to the image
+    void invalidate(int x, int y, int w, int h);
+    void invalidateAll();
+    // Recomputes the dirty tiles from `base`, the width x height level 0
+    void update(const RGBA *base, const Execution &execution = {});
+    bool dirty() const { return m_dirty; }
+
+    int levelCount() const { return static_cast<int>(m_levels.size()); }
+    int width(int level) const { return m_levels[level].width; }
+    int height(int level) const { return m_levels[level].height; }
+    // Pixels of a stored level (level >= 1); valid after update()
+    const std::vector<RGBA> &pixels(int level) const { return m_levels[level].pixels; }
+
+    // First level whose longest side is at most maxSide (the last level if
+    // none is that small)
+    int levelAtMost(int maxSide) const;
+
+private:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        int tilesX = 0;
+        int tilesY = 0;
+        std::vector<RGBA> pixels;
+        std::vector<std::uint8_t> dirtyTiles;
+    };
+    std::vector<Level> m_levels;
+    bool m_dirty = false;
+};
+
+#endif // MIPPYRAMID_H
@@ -0,0 +1,53 @@
+#include "parallel.h"
+#include "taskpool.h"
+#include "trace.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+int resolveThreads(int threads) {
+    if (threads > 0) {
+        return threads;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallelFor(int begin, int end, const Execution &execution, const std::function<void(int, int)> &body, int grain) {
+    int count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+    int wanted = execution.pool && execution.threads == 0 ? execution.pool->threadCount() * kTilesPerPoolThread
+                                                          : resolveThreads(execution.threads);
+    int bands = std::min(wanted, std::max(1, count / std::max(1, grain)));
+    if (bands == 1) {
+        body(begin, end);
+        return;
+    }
+
+    auto runBand = [&body](int bandBegin, int bandEnd) {
+        TRACE_SPAN("parallelFor.band");
+        body(bandBegin, bandEnd);
+    };
+    auto bandStart = [&](int band) { return begin + static_cast<int>(static_cast<long long>(count) * band / bands); };
+
+    if (execution.pool) {
+        TaskPool::Group group;
+        for (int band = 1; band < bands; band++) {
+            execution.pool->run(group, [&runBand, b0 = bandStart(band), b1 = bandStart(band + 1)] { runBand(b0, b1); });
+        }
+        runBand(bandStart(0), bandStart(1));
+        execution.pool->wait(group);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(bands - 1);
+    for (int band = 1; band < bands; band++) {
+        workers.emplace_back(runBand, bandStart(band), bandStart(band + 1));
+    }
+    runBand(bandStart(0), bandStart(1));
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstdint>
+#include <functional>
+#include "jobcontrol.h"
+
+class TaskPool;
+
+/**
+ * @struct Execution
+ *
+ * How a kernel is run. Every combination produces the same output, so the
+ * plain serial scalar setting doubles as the reference when comparing
+ * backends.
+ */
+struct Execution {
+    bool simd = true;   // SSE2 inner loops, where the build has them
+    int threads = 1;    // bands processed in parallel; 0 = one per core
+    JobControl *job = nullptr;  // optional progress and cancellation
+    TaskPool *pool = nullptr;   // run bands as tasks on this pool instead of
+                                // starting threads (see parallelFor)
+};
+
+// Announces `rows` rows of upcoming work to the job, if any
+inline void addRows(const Execution &execution, std::int64_t rows) {
+    if (execution.job) {
+        execution.job->addWork(rows);
+    }
+}
+
+// Row loop checkpoint: credits one finished row to the job, if any, and
+// returns false once the job has been cancelled
+inline bool rowDone(const Execution &execution) {
+    if (!execution.job) {
+        return true;
+    }
+    execution.job->completeWork(1);
+    return !execution.job->cancelled();
+}
+
+// Number of threads a requested count resolves to (0 = hardware concurrency)
+int resolveThreads(int threads);
+
+// Bands per pool thread when execution.threads is 0, so idle workers have
+// something left to steal
+constexpr int kTilesPerPoolThread = 4;
+
+/**
+ * Splits [begin, end) into contiguous bands of at least `grain` items and
+ * calls body(bandBegin, bandEnd) for each. Without a pool there are at most
+ * execution.threads bands, each on its own thread. With execution.pool the
+ * bands (execution.threads of them, or kTilesPerPoolThread per pool thread)
+ * are queued as tasks, so bands of many images share the pool's threads.
+ * The first band runs on the calling thread; returns once every band is
+ * done.
+ */
+void parallelFor(int begin, int end, const Execution &execution, const std::function<void(int, int)> &body, int grain = 16);
+
+#endif // PARALLEL_H
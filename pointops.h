@@ -0,0 +1,72 @@
+#ifndef POINTOPS_H
+#define POINTOPS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "rgba.h"
+
+/**
+ * @class PointOp
+ *
+ * A chain of per-pixel color operations (gray, gamma, tone curves, levels)
+ * folded into 256-entry lookup tables: one per channel before an optional
+ * gray conversion and one per channel after it. Appending an operation only
+ * rewrites the tables, so a chain of any length costs one lookup per channel
+ * and pixel. Operations work on 8-bit values; alpha is never touched.
+ *
+ * WorkImage keeps the ops that have not reached the pixels yet and applies
+ * them during its next layout conversion (see WorkImage::pendingOps).
+ */
+class PointOp {
+public:
+    using Table = std::array<std::uint8_t, 256>;
+
+    PointOp();
+
+    // Gray as rgbaToGray() computes it, written to all three channels
+    static PointOp gray();
+    // 255 * (v / 255)^gamma
+    static PointOp gamma(float gamma);
+    // Piecewise linear through (input, output) points sorted by input, flat
+    // outside them
+    static PointOp curve(const std::vector<std::pair<int, int>> &points);
+    // Maps [inBlack, inWhite] onto [outBlack, outWhite], with `gamma` > 1
+    // brightening the midtones as in the usual levels dialog
+    static PointOp levels(int inBlack, int inWhite, float gamma = 1, int outBlack = 0, int outWhite = 255);
+
+    // Makes this op "this, then next"
+    void append(const PointOp &next);
+    bool isIdentity() const;
+    // Without a gray conversion each channel maps through its own table
+    bool isPerChannel() const { return !m_gray; }
+    const Table &channelTable(int channel) const { return m_pre[channel]; }
+
+    // Maps count pixels given as planes. The output planes may be the input
+    // planes. With `simd` (see Execution::simd) per-channel tables are looked
+    // up 32 bytes at a time where the CPU has AVX2; the result is the same.
+    void apply(const std::uint8_t *r, const std::uint8_t *g, const std::uint8_t *b, size_t count,
+               std::uint8_t *outR, std::uint8_t *outG, std::uint8_t *outB, bool simd = true) const;
+    void apply(const RGBA *src, size_t count, RGBA *dst) const;
+
+private:
+    Table m_pre[3];
+    bool m_gray = false;
+    Table m_post[3];    // indexed by gray value; identity unless m_gray
+    // Gray weights with m_pre folded in, valid if m_gray
+    std::array<double, 256> m_grayWeights[3] = {};
+
+    void updateGrayWeights();
+};
+
+// 0.299 * v, 0.587 * v and 0.114 * v for every 8-bit v, rounded exactly as
+// the double arithmetic of the original gray conversion, so table sums
+// truncate to the same gray values
+const std::array<std::array<double, 256>, 3> &grayProducts();
+
+// Gray of each pixel of three planes, as rgbaToGray()
+void grayPlane(const std::uint8_t *r, const std::uint8_t *g, const std::uint8_t *b, size_t count, std::uint8_t *out);
+
+#endif // POINTOPS_H
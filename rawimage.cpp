@@ -0,0 +1,266 @@
+#include "rawimage.h"
+#include "trace.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define RAWIMAGE_MMAP 0
+#else
+#define RAWIMAGE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef RASTER_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef RASTER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static_assert(sizeof(RGBA) == 4, "RGBA must be tightly packed");
+
+bool isRawImagePath(const std::string &path) {
+    std::string suffix = std::string(".") + kRawImageSuffix;
+    if (path.size() < suffix.size()) {
+        return false;
+    }
+    return std::equal(suffix.begin(), suffix.end(), path.end() - suffix.size(),
+                      [](char a, char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+}
+
+bool rawCompressionAvailable(RawCompression compression) {
+    switch (compression) {
+    case RawCompression::None:
+        return true;
+    case RawCompression::LZ4:
+#ifdef RASTER_HAVE_LZ4
+        return true;
+#else
+        return false;
+#endif
+    case RawCompression::Zstd:
+#ifdef RASTER_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+RawImageFile::~RawImageFile() {
+    close();
+}
+
+bool RawImageFile::open(const std::string &path) {
+    TRACE_SPAN("rawImage.open");
+    close();
+#if RAWIMAGE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout<<"Failed to open "<<path<<std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(RawImageHeader))) {
+        std::cout<<"Not a raw image: "<<path<<std::endl;
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cout<<"Failed to map "<<path<<std::endl;
+        return false;
+    }
+    m_data = static_cast<const std::uint8_t*>(mapping);
+    m_size = info.st_size;
+#else
+    std::ifstream file(path, std::ios::binary);
+    m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!file && !file.eof()) {
+        std::cout<<"Failed to open "<<path<<std::endl;
+        return false;
+    }
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#endif
+
+    if (m_size >= sizeof(RawImageHeader)) {
+        std::memcpy(&m_header, m_data, sizeof(RawImageHeader));
+    }
+    std::uint64_t rawBytes = static_cast<std::uint64_t>(m_header.width) * m_header.height * sizeof(RGBA);
+    bool valid = m_size >= sizeof(RawImageHeader) && std::memcmp(m_header.magic, "RIMG", 4) == 0 &&
+                 m_header.version == kRawImageVersion &&
+                 m_header.payloadBytes <= m_size - sizeof(RawImageHeader) &&
+                 (compression() != RawCompression::None || m_header.payloadBytes == rawBytes);
+    if (!valid) {
+        std::cout<<"Not a raw image: "<<path<<std::endl;
+        close();
+        return false;
+    }
+    if (!rawCompressionAvailable(compression())) {
+        std::cout<<"Raw image compression not available in this build: "<<path<<std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void RawImageFile::close() {
+#if RAWIMAGE_MMAP
+    if (m_data) {
+        munmap(const_cast<std::uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_buffer.clear();
+    m_data = nullptr;
+    m_size = 0;
+    m_header = RawImageHeader{};
+}
+
+const RGBA *RawImageFile::pixels() const {
+    if (!m_data || compression() != RawCompression::None) {
+        return nullptr;
+    }
+    return reinterpret_cast<const RGBA*>(m_data + sizeof(RawImageHeader));
+}
+
+bool RawImageFile::read(std::vector<RGBA> &out) const {
+    TRACE_SPAN("rawImage.read");
+    if (!m_data) {
+        return false;
+    }
+    size_t count = static_cast<size_t>(width()) * height();
+    const std::uint8_t *payload = m_data + sizeof(RawImageHeader);
+    out.resize(count);
+
+    switch (compression()) {
+    case RawCompression::None:
+        std::memcpy(out.data(), payload, count * sizeof(RGBA));
+        return true;
+    case RawCompression::LZ4:
+#ifdef RASTER_HAVE_LZ4
+        return LZ4_decompress_safe(reinterpret_cast<const char*>(payload), reinterpret_cast<char*>(out.data()),
+                                   static_cast<int>(m_header.payloadBytes), static_cast<int>(count * sizeof(RGBA)))
+               == static_cast<int>(count * sizeof(RGBA));
+#else
+        return false;
+#endif
+    case RawCompression::Zstd:
+#ifdef RASTER_HAVE_ZSTD
+        return ZSTD_decompress(out.data(), count * sizeof(RGBA), payload, m_header.payloadBytes) == count * sizeof(RGBA);
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * @brief Writes header and payload with one writev where available
+ */
+static bool writeFile(const std::string &path, const RawImageHeader &header, const void *payload, size_t bytes) {
+#if RAWIMAGE_MMAP
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    iovec parts[2] = {{const_cast<RawImageHeader*>(&header), sizeof(header)}, {const_cast<void*>(payload), bytes}};
+    size_t total = sizeof(header) + bytes;
+    size_t written = 0;
+    while (written < total) {
+        ssize_t n = writev(fd, parts, 2);
+        if (n <= 0) {
+            ::close(fd);
+            return false;
+        }
+        written += n;
+        // Short write: skip what went out and go again
+        for (iovec &part : parts) {
+            size_t skip = std::min(part.iov_len, static_cast<size_t>(n));
+            part.iov_base = static_cast<char*>(part.iov_base) + skip;
+            part.iov_len -= skip;
+            n -= skip;
+        }
+    }
+    return ::close(fd) == 0;
+#else
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(static_cast<const char*>(payload), bytes);
+    return static_cast<bool>(file);
+#endif
+}
+
+bool saveRawImage(const std::string &path, const RGBA *pixels, int width, int height, RawCompression compression) {
+    TRACE_SPAN("rawImage.save");
+    if (!rawCompressionAvailable(compression)) {
+        std::cout<<"Raw image compression not available in this build"<<std::endl;
+        return false;
+    }
+    RawImageHeader header{};
+    std::memcpy(header.magic, "RIMG", 4);
+    header.version = kRawImageVersion;
+    header.compression = static_cast<std::uint16_t>(compression);
+    header.width = width;
+    header.height = height;
+
+    size_t rawBytes = static_cast<size_t>(width) * height * sizeof(RGBA);
+    const void *payload = pixels;
+    size_t payloadBytes = rawBytes;
+    std::vector<std::uint8_t> packed;
+#ifdef RASTER_HAVE_LZ4
+    if (compression == RawCompression::LZ4) {
+        if (rawBytes > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+            std::cout<<"Image too large for LZ4"<<std::endl;
+            return false;
+        }
+        packed.resize(LZ4_compressBound(static_cast<int>(rawBytes)));
+        int n = LZ4_compress_default(reinterpret_cast<const char*>(pixels), reinterpret_cast<char*>(packed.data()),
+                                     static_cast<int>(rawBytes), static_cast<int>(packed.size()));
+        if (n <= 0) {
+            std::cout<<"Failed to compress image"<<std::endl;
+            return false;
+        }
+        payload = packed.data();
+        payloadBytes = n;
+    }
+#endif
+#ifdef RASTER_HAVE_ZSTD
+    if (compression == RawCompression::Zstd) {
+        packed.resize(ZSTD_compressBound(rawBytes));
+        size_t n = ZSTD_compress(packed.data(), packed.size(), pixels, rawBytes, 1);
+        if (ZSTD_isError(n)) {
+            std::cout<<"Failed to compress image"<<std::endl;
+            return false;
+        }
+        payload = packed.data();
+        payloadBytes = n;
+    }
+#endif
+    header.payloadBytes = payloadBytes;
+
+    if (!writeFile(path, header, payload, payloadBytes)) {
+        std::cout<<"Failed to save image"<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool loadRawImage(const std::string &path, std::vector<RGBA> &pixels, int &width, int &height) {
+    RawImageFile file;
+    if (!file.open(path) || !file.read(pixels)) {
+        return false;
+    }
+    width = file.width();
+    height = file.height();
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef RAWIMAGE_H
+#define RAWIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "rgba.h"
+
+/**
+ * Native intermediate format (.rimg): a 32-byte header followed by the RGBA
+ * rows exactly as they sit in memory, optionally compressed as one LZ4 or
+ * zstd frame. Uncompressed files load by mapping the file and copying (or
+ * directly using) the rows, with nothing to parse, and save with one write.
+ * The codecs are only available when the build found them
+ * (RASTER_HAVE_LZ4, RASTER_HAVE_ZSTD).
+ *
+ * Fields are stored in host byte order; files are meant for moving images
+ * between pipeline steps on the same machine, not for archiving.
+ */
+
+enum class RawCompression : std::uint16_t {
+    None = 0,
+    LZ4 = 1,
+    Zstd = 2
+};
+
+struct RawImageHeader {
+    char magic[4];              // "RIMG"
+    std::uint16_t version;      // kRawImageVersion
+    std::uint16_t compression;  // RawCompression
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint64_t payloadBytes; // bytes after the header
+    std::uint64_t reserved;
+};
+static_assert(sizeof(RawImageHeader) == 32, "RawImageHeader must stay 32 bytes");
+
+constexpr std::uint16_t kRawImageVersion = 1;
+constexpr const char *kRawImageSuffix = "rimg";
+
+// True if `path` ends in .rimg (any case)
+bool isRawImagePath(const std::string &path);
+bool rawCompressionAvailable(RawCompression compression);
+
+/**
+ * @class RawImageFile
+ *
+ * A .rimg file mapped read-only. The mapping lives until close() or
+ * destruction.
+ */
+class RawImageFile {
+public:
+    RawImageFile() = default;
+    ~RawImageFile();
+    RawImageFile(const RawImageFile &) = delete;
+    RawImageFile &operator=(const RawImageFile &) = delete;
+
+    // Maps the file and checks the header
+    bool open(const std::string &path);
+    void close();
+
+    int width() const { return m_header.width; }
+    int height() const { return m_header.height; }
+    RawCompression compression() const { return static_cast<RawCompression>(m_header.compression); }
+
+    // The rows inside the mapping, or nullptr for compressed files
+    const RGBA *pixels() const;
+    // Copies (or decompresses) the rows into `out`
+    bool read(std::vector<RGBA> &out) const;
+
+private:
+    RawImageHeader m_header{};
+    const std::uint8_t *m_data = nullptr;   // whole file
+    std::size_t m_size = 0;
+    std::vector<std::uint8_t> m_buffer;     // file contents where mmap is unavailable
+};
+
+bool saveRawImage(const std::string &path, const RGBA *pixels, int width, int height,
+                  RawCompression compression = RawCompression::None);
+bool loadRawImage(const std::string &path, std::vector<RGBA> &pixels, int &width, int &height);
+
+#endif // RAWIMAGE_H
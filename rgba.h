@@ -8,10 +8,3 @@ struct RGBA {
     std::uint8_t b;
     std::uint8_t a = 255;
 };
-
-struct SOBELIMG {
-    float r;
-    float g;
-    float b;
-    std::uint8_t a = 255;
-};
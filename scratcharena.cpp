@@ -0,0 +1,36 @@
+#include "scratcharena.h"
+#include <algorithm>
+#include <new>
+
+/**
+ * @brief Hands out the next block, growing it first if it is too small.
+ * Growing drops the old contents, which belong to an earlier frame anyway.
+ */
+void *ScratchArena::takeBytes(std::size_t bytes) {
+    if (m_next == m_blocks.size()) {
+        m_blocks.emplace_back();
+    }
+    Block &block = m_blocks[m_next++];
+    if (block.size < bytes) {
+        // Rounded up to whole cache lines
+        std::size_t size = std::max<std::size_t>(kAlignment, (bytes + kAlignment - 1) / kAlignment * kAlignment);
+        block.data.reset();
+        block.data.reset(::operator new(size, std::align_val_t(kAlignment)));
+        block.size = size;
+        m_allocations++;
+    }
+    return block.data.get();
+}
+
+std::size_t ScratchArena::reservedBytes() const {
+    std::size_t total = 0;
+    for (const Block &block : m_blocks) {
+        total += block.size;
+    }
+    return total;
+}
+
+void ScratchArena::clear() {
+    m_blocks.clear();
+    m_next = 0;
+}
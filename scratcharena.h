@@ -0,0 +1,71 @@
+#ifndef SCRATCHARENA_H
+#define SCRATCHARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * @class ScratchArena
+ *
+ * Temporary buffers for the filters, kept between calls. Buffers are handed
+ * out in order from a list of blocks; a Frame gives back everything taken
+ * while it was alive. A filter that asks for the same buffers on every call
+ * therefore gets the same blocks back and allocates nothing after the first
+ * image of a given size. Blocks only ever grow.
+ *
+ * Buffers are uninitialized and aligned to kAlignment. Take them on the
+ * calling thread, before handing them to parallel work. Blocks come from the
+ * aligned operator new, so a replaced global allocator sees them.
+ */
+class ScratchArena {
+public:
+    static constexpr std::size_t kAlignment = 64;
+
+    ScratchArena() = default;
+    // Nothing taken from an arena outlives its frame, so a copy starts empty
+    ScratchArena(const ScratchArena &) {}
+    ScratchArena &operator=(const ScratchArena &) { return *this; }
+    ScratchArena(ScratchArena &&) = default;
+    ScratchArena &operator=(ScratchArena &&) = default;
+
+    class Frame {
+    public:
+        explicit Frame(ScratchArena &arena) : m_arena(arena), m_mark(arena.m_next) {}
+        ~Frame() { m_arena.m_next = m_mark; }
+        Frame(const Frame &) = delete;
+        Frame &operator=(const Frame &) = delete;
+    private:
+        ScratchArena &m_arena;
+        std::size_t m_mark;
+    };
+
+    // Room for `count` Ts, valid until the enclosing Frame ends. T must be
+    // trivially copyable; nothing is constructed.
+    template <typename T>
+    T *take(std::size_t count) { return static_cast<T*>(takeBytes(count * sizeof(T))); }
+
+    // Number of blocks allocated (or grown) so far, and their total size
+    std::size_t allocations() const { return m_allocations; }
+    std::size_t reservedBytes() const;
+
+    // Frees every block; must not be called inside a Frame
+    void clear();
+
+private:
+    struct Free {
+        void operator()(void *p) const { ::operator delete(p, std::align_val_t(kAlignment)); }
+    };
+    struct Block {
+        std::unique_ptr<void, Free> data;
+        std::size_t size = 0;
+    };
+    std::vector<Block> m_blocks;
+    std::size_t m_next = 0;
+    std::size_t m_allocations = 0;
+
+    void *takeBytes(std::size_t bytes);
+};
+
+#endif // SCRATCHARENA_H
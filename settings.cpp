@@ -14,9 +14,51 @@
 
 #include "settings.h"
 #include <QSettings>
+#include <QThreadPool>
+#include <QTimer>
+#include <memory>
 
 Settings settings;
 
+// How long the settings must stay unchanged before saveSettingsLater()
+// writes them
+static constexpr int kSaveDelayMs = 500;
+
+/**
+ * @brief The pending save of saveSettingsLater(). The timer restarts on
+ * every change; when it fires, a copy of the settings is taken on the GUI
+ * thread and written on a single writer thread, so writes land in order.
+ */
+struct SettingsWriter {
+    QTimer timer;
+    QThreadPool pool;
+    const Settings *source = nullptr;
+
+    SettingsWriter() {
+        timer.setSingleShot(true);
+        timer.setInterval(kSaveDelayMs);
+        pool.setMaxThreadCount(1);
+        QObject::connect(&timer, &QTimer::timeout, [this]{ writeLater(); });
+    }
+
+    void writeLater() {
+        Settings snapshot = *source;
+        pool.start([snapshot]() mutable { snapshot.saveSettings(); });
+    }
+};
+
+// Created by the first saveSettingsLater() and destroyed by flushSettings(),
+// so its timer and thread go away while QApplication still exists rather
+// than with the statics after main() returns
+static std::unique_ptr<SettingsWriter> s_writer;
+
+static SettingsWriter &settingsWriter() {
+    if (!s_writer) {
+        s_writer = std::make_unique<SettingsWriter>();
+    }
+    return *s_writer;
+}
+
 /**
  * @brief Loads the application settings
  */
@@ -47,6 +89,9 @@ void Settings::loadSettingsOrDefaults() {
     nonLinearMap = s.value("nonLinearMap", false).toBool();
     gamma = s.value("gamma", 0.1).toFloat();
 
+    pngCompression = s.value("pngCompression", 6).toInt();
+    jpegQuality = s.value("jpegQuality", 75).toInt();
+
     imagePath = s.value("imagePath", "").toString();
 }
 
@@ -80,5 +125,26 @@ void Settings::saveSettings() {
     s.setValue("nonLinearMap", nonLinearMap);
     s.setValue("gamma", gamma);
 
+    s.setValue("pngCompression", pngCompression);
+    s.setValue("jpegQuality", jpegQuality);
+
     s.setValue("imagePath", imagePath);
 }
+
+void Settings::saveSettingsLater() {
+    SettingsWriter &writer = settingsWriter();
+    writer.source = this;
+    writer.timer.start();
+}
+
+void Settings::flushSettings() {
+    if (!s_writer) {
+        return;
+    }
+    if (s_writer->timer.isActive()) {
+        s_writer->timer.stop();
+        s_writer->writeLater();
+    }
+    s_writer->pool.waitForDone();
+    s_writer.reset();
+}
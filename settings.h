@@ -46,6 +46,11 @@ enum FilterType {
  * The settings will be automatically updated when things are changed in the
  * GUI (the reverse is not true however: changing the value of a setting does
  * not update the GUI).
+ *
+ * The global is only read and written on the GUI thread. Operations that
+ * outlive the call that started them take a copy of the values they need
+ * there (FilterStep for filters, BrushSettings per stroke, SaveOptions), so
+ * background work never sees a control change halfway through.
 */
 struct Settings {
     // Brush
@@ -70,10 +75,22 @@ struct Settings {
     bool nonLinearMap;              // Use non-linear mapping function for tone mapping (extra credit)
     float gamma;                    // Gamma for tone mapping (extra credit)
 
+    // Saving
+    int pngCompression;             // zlib level 0-9
+    int jpegQuality;                // 0-100
+
     QString imagePath;
 
     void loadSettingsOrDefaults();
+    // Writes the settings to QSettings now
     void saveSettings();
+    // Saves the settings once they have been left alone for a moment, on a
+    // background thread; a burst of changes (dragging a spin box) ends in
+    // one write of its last values. GUI thread only.
+    void saveSettingsLater();
+    // Writes a save still waiting in saveSettingsLater(), waits until it is
+    // on disk and destroys the writer; call before QApplication goes away
+    void flushSettings();
 };
 
 // The global Settings object, will be initialized by MainWindow
@@ -0,0 +1,173 @@
+#include "strokes.h"
+#include "rawimage.h"
+#include "settings.h"
+#include "trace.h"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// First line of a recording file
+static const char *kStrokeHeader = "raster-strokes 1";
+
+BrushSettings currentBrushSettings() {
+    BrushSettings brush;
+    brush.type = settings.brushType;
+    brush.radius = settings.brushRadius;
+    brush.color = settings.brushColor;
+    brush.linearBlending = settings.fixAlphaBlending;
+    return brush;
+}
+
+void configureBrush(BrushEngine &brush, const BrushSettings &brushSettings) {
+    brush.setLinearBlending(brushSettings.linearBlending);
+    if (brushSettings.type == BRUSH_CONSTANT) {
+        brush.initConstantMask(brushSettings.radius);
+    } else if (brushSettings.type == BRUSH_LINEAR) {
+        brush.initLinearMask(brushSettings.radius);
+    } else if (brushSettings.type == BRUSH_QUADRATIC) {
+        brush.initQuadraticMask(brushSettings.radius);
+    } else if (brushSettings.type == BRUSH_SMUDGE) {
+        brush.initLinearMask(brushSettings.radius);
+    }
+}
+
+void beginStroke(BrushEngine &brush, const BrushSettings &brushSettings, const std::vector<RGBA> &canvas,
+                 int width, int height, int x, int y) {
+    if (brushSettings.type == BRUSH_SMUDGE) {
+        brush.pickUp(canvas, width, height, x, y);
+    }
+}
+
+void brushDab(BrushEngine &brush, const BrushSettings &brushSettings, std::vector<RGBA> &canvas,
+              int width, int height, int x, int y) {
+    if (brushSettings.type == BRUSH_SMUDGE) {
+        brush.smudge(canvas, width, height, x, y);
+        brush.pickUp(canvas, width, height, x, y);
+    } else {
+        brush.stamp(canvas, width, height, x, y, brushSettings.color);
+    }
+}
+
+/**
+ * @brief Format:
+ *   raster-strokes 1
+ *   canvas <width> <height>
+ *   checksum <16 hex digits>
+ *   stroke <type> <radius> <r> <g> <b> <a> <linear blending 0/1>
+ *   p <microseconds> <x> <y>
+ *   ...
+ * with a "stroke" line per stroke followed by its points
+ */
+bool saveStrokeRecording(const std::string &path, const StrokeRecording &recording) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cout<<"Failed to open "<<path<<std::endl;
+        return false;
+    }
+    char checksum[17];
+    std::snprintf(checksum, sizeof(checksum), "%016" PRIx64, recording.checksum);
+    out<<kStrokeHeader<<"\n";
+    out<<"canvas "<<recording.width<<" "<<recording.height<<"\n";
+    out<<"checksum "<<checksum<<"\n";
+    for (const Stroke &stroke : recording.strokes) {
+        const BrushSettings &brush = stroke.brush;
+        out<<"stroke "<<brush.type<<" "<<brush.radius<<" "<<int(brush.color.r)<<" "<<int(brush.color.g)<<" "
+           <<int(brush.color.b)<<" "<<int(brush.color.a)<<" "<<int(brush.linearBlending)<<"\n";
+        for (const StrokePoint &point : stroke.points) {
+            out<<"p "<<point.timeUs<<" "<<point.x<<" "<<point.y<<"\n";
+        }
+    }
+    out.close();
+    if (!out) {
+        std::cout<<"Failed to write "<<path<<std::endl;
+        return false;
+    }
+    return saveRawImage(path + "." + kRawImageSuffix, recording.base.data(), recording.width, recording.height);
+}
+
+bool loadStrokeRecording(const std::string &path, StrokeRecording &recording) {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line) || line != kStrokeHeader) {
+        std::cout<<"Not a stroke recording: "<<path<<std::endl;
+        return false;
+    }
+
+    recording = StrokeRecording();
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        fields>>key;
+        if (key == "canvas") {
+            fields>>recording.width>>recording.height;
+        } else if (key == "checksum") {
+            fields>>std::hex>>recording.checksum;
+        } else if (key == "stroke") {
+            Stroke stroke;
+            int r, g, b, a, linear;
+            fields>>stroke.brush.type>>stroke.brush.radius>>r>>g>>b>>a>>linear;
+            stroke.brush.color = RGBA{static_cast<std::uint8_t>(r), static_cast<std::uint8_t>(g),
+                                      static_cast<std::uint8_t>(b), static_cast<std::uint8_t>(a)};
+            stroke.brush.linearBlending = linear != 0;
+            recording.strokes.push_back(stroke);
+        } else if (key == "p" && !recording.strokes.empty()) {
+            StrokePoint point;
+            fields>>point.timeUs>>point.x>>point.y;
+            recording.strokes.back().points.push_back(point);
+        } else if (!key.empty()) {
+            fields.setstate(std::ios::failbit);
+        }
+        if (fields.fail()) {
+            std::cout<<"Malformed line in "<<path<<": "<<line<<std::endl;
+            return false;
+        }
+    }
+
+    RawImageFile base;
+    if (!base.open(path + "." + kRawImageSuffix) || !base.read(recording.base)) {
+        return false;
+    }
+    if (base.width() != recording.width || base.height() != recording.height) {
+        std::cout<<"Base canvas does not match the recording: "<<path<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+ReplayResult replayStrokes(const StrokeRecording &recording, std::vector<RGBA> &canvas) {
+    TRACE_SPAN("replayStrokes");
+    ReplayResult result;
+    canvas = recording.base;
+    int width = recording.width;
+    int height = recording.height;
+    BrushEngine brush;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const Stroke &stroke : recording.strokes) {
+        if (stroke.points.empty()) {
+            continue;
+        }
+        configureBrush(brush, stroke.brush);
+        beginStroke(brush, stroke.brush, canvas, width, height, stroke.points[0].x, stroke.points[0].y);
+        for (const StrokePoint &point : stroke.points) {
+            brushDab(brush, stroke.brush, canvas, width, height, point.x, point.y);
+            result.pixelsWritten += brush.footprint(width, height, point.x, point.y);
+        }
+        result.stamps += stroke.points.size();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.checksum = imageChecksum(canvas);
+    return result;
+}
+
+std::uint64_t imageChecksum(const std::vector<RGBA> &pixels) {
+    std::uint64_t hash = 14695981039346656037ull;
+    const auto *bytes = reinterpret_cast<const unsigned char*>(pixels.data());
+    for (size_t i = 0; i < pixels.size() * sizeof(RGBA); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,83 @@
+#ifndef STROKES_H
+#define STROKES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "brushengine.h"
+#include "rgba.h"
+
+/**
+ * The brush part of Settings, as in effect for one stroke
+ */
+struct BrushSettings {
+    int type = 0;                   // @see BrushType
+    int radius = 0;
+    RGBA color;
+    bool linearBlending = false;    // Settings::fixAlphaBlending
+};
+
+// The brush currently selected in the UI
+BrushSettings currentBrushSettings();
+
+// Builds the mask for the brush type and radius, as on every mouse down
+void configureBrush(BrushEngine &brush, const BrushSettings &brushSettings);
+// Mouse down at (x, y): the smudge brush picks up paint there. The first dab
+// follows with brushDab() at the same point.
+void beginStroke(BrushEngine &brush, const BrushSettings &brushSettings, const std::vector<RGBA> &canvas,
+                 int width, int height, int x, int y);
+// One dab at (x, y), as for every mouse move while the button is down
+void brushDab(BrushEngine &brush, const BrushSettings &brushSettings, std::vector<RGBA> &canvas,
+              int width, int height, int x, int y);
+
+struct StrokePoint {
+    std::int64_t timeUs;    // since the recording started
+    int x;
+    int y;
+};
+
+// Mouse down at points[0], a dab at every point, then mouse up
+struct Stroke {
+    BrushSettings brush;
+    std::vector<StrokePoint> points;
+};
+
+/**
+ * @struct StrokeRecording
+ *
+ * A brush session, replayable without the GUI: the canvas it started from,
+ * the strokes painted on it and the checksum of the result. Only strokes
+ * are recorded; filters, loads and clears during a recording make a replay
+ * end on a different checksum.
+ *
+ * Saved as text, one stroke header line followed by one line per point, and
+ * the starting canvas next to it as "<path>.rimg".
+ */
+struct StrokeRecording {
+    int width = 0;
+    int height = 0;
+    std::vector<RGBA> base;
+    std::vector<Stroke> strokes;
+    std::uint64_t checksum = 0;     // imageChecksum() of the final canvas
+};
+
+bool saveStrokeRecording(const std::string &path, const StrokeRecording &recording);
+bool loadStrokeRecording(const std::string &path, StrokeRecording &recording);
+
+struct ReplayResult {
+    std::int64_t stamps = 0;
+    std::int64_t pixelsWritten = 0;     // canvas pixels under the dabs' masks
+    double seconds = 0;                 // dabs only, not copying the base
+    std::uint64_t checksum = 0;
+
+    double stampsPerSecond() const { return seconds > 0 ? stamps / seconds : 0; }
+};
+
+// Replays the strokes on a copy of the base canvas, left in `canvas`, as
+// fast as the brushes go; the recorded times are not waited for
+ReplayResult replayStrokes(const StrokeRecording &recording, std::vector<RGBA> &canvas);
+
+// 64-bit FNV-1a of the pixel bytes
+std::uint64_t imageChecksum(const std::vector<RGBA> &pixels);
+
+#endif // STROKES_H
@@ -0,0 +1,147 @@
+#include "taskpool.h"
+#include "parallel.h"
+#include "trace.h"
+#include <chrono>
+
+// The pool and queue index of the current thread, if it is a pool worker
+static thread_local const TaskPool *t_pool = nullptr;
+static thread_local int t_queue = -1;
+// Time this thread has spent inside wait(), to take out of task busy time
+static thread_local std::int64_t t_waitNs = 0;
+
+static std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TaskPool::TaskPool(int threads) {
+    int count = resolveThreads(threads);
+    for (int i = 0; i <= count; i++) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    m_threads.reserve(count);
+    for (int i = 0; i < count; i++) {
+        m_threads.emplace_back(&TaskPool::workerLoop, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Queue the current thread pushes to: its own for workers of this
+ * pool, the shared one for everybody else
+ */
+int TaskPool::queueIndex() const {
+    return t_pool == this ? t_queue : static_cast<int>(m_queues.size()) - 1;
+}
+
+void TaskPool::run(Group &group, std::function<void()> task) {
+    group.m_pending.fetch_add(1, std::memory_order_relaxed);
+    Queue &queue = *m_queues[queueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{std::move(task), &group});
+    }
+    m_queued.fetch_add(1, std::memory_order_release);
+    // Taking the lock orders the push before any sleeper's predicate check
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_wake.notify_one();
+}
+
+/**
+ * @brief Pops the newest task from our own queue, or steals the oldest one
+ * from another queue. With `only` set, tasks of other groups are skipped.
+ */
+bool TaskPool::takeTask(int self, const Group *only, Task &task) {
+    int queues = static_cast<int>(m_queues.size());
+    for (int k = 0; k < queues; k++) {
+        int index = (self + k) % queues;
+        Queue &queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (k == 0) {
+            auto it = queue.tasks.end();
+            while (it != queue.tasks.begin()) {
+                --it;
+                if (!only || it->group == only) {
+                    task = std::move(*it);
+                    queue.tasks.erase(it);
+                    m_queued.fetch_sub(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        } else {
+            for (auto it = queue.tasks.begin(); it != queue.tasks.end(); ++it) {
+                if (!only || it->group == only) {
+                    task = std::move(*it);
+                    queue.tasks.erase(it);
+                    m_queued.fetch_sub(1, std::memory_order_relaxed);
+                    m_steals.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void TaskPool::execute(Task &task) {
+    std::int64_t start = nowNs();
+    std::int64_t waitedBefore = t_waitNs;
+    task.function();
+    // Nested tasks run inside wait() count their own time
+    m_busyNs.fetch_add(nowNs() - start - (t_waitNs - waitedBefore), std::memory_order_relaxed);
+    m_tasksRun.fetch_add(1, std::memory_order_relaxed);
+    if (task.group->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        // Last task of the group: wake whoever waits for it
+        { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+        m_groupDone.notify_all();
+    }
+}
+
+void TaskPool::wait(Group &group) {
+    TRACE_SPAN("taskPool.wait");
+    std::int64_t start = nowNs();
+    std::int64_t waitedBefore = t_waitNs;
+    int self = queueIndex();
+    Task task;
+    while (!group.done()) {
+        if (takeTask(self, &group, task)) {
+            execute(task);
+            continue;
+        }
+        // The rest of the group is running elsewhere and notifies when done.
+        // Subtasks it queues meanwhile are picked up on the next poll.
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_groupDone.wait_for(lock, std::chrono::milliseconds(1), [&] { return group.done(); });
+    }
+    // Waits nested in tasks run here are part of this one
+    t_waitNs = waitedBefore + (nowNs() - start);
+}
+
+void TaskPool::workerLoop(int index) {
+    t_pool = this;
+    t_queue = index;
+    Task task;
+    while (true) {
+        if (takeTask(index, nullptr, task)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [&] { return m_stopping || m_queued.load(std::memory_order_acquire) > 0; });
+        if (m_stopping && m_queued.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
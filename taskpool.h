@@ -0,0 +1,90 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class TaskPool
+ *
+ * Fixed set of worker threads with one task deque each. A worker pushes the
+ * tasks it spawns onto its own deque and pops them newest first; when its
+ * deque is empty it steals the oldest task from another worker. Tasks
+ * submitted from outside the pool go to a shared deque that every worker
+ * steals from.
+ *
+ * Tasks are tracked in Groups. wait() blocks until every task of a group has
+ * finished and, while it waits, runs queued tasks of that same group (never
+ * unrelated ones, so a waiting task cannot get stuck behind a long task it
+ * picked up). A task may therefore submit subtasks and wait for them.
+ */
+class TaskPool {
+public:
+    class Group {
+    public:
+        bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+    private:
+        friend class TaskPool;
+        std::atomic<int> m_pending{0};
+    };
+
+    // threads = 0 starts one worker per core
+    explicit TaskPool(int threads = 0);
+    // Finishes every queued task, then stops the workers
+    ~TaskPool();
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+    int threadCount() const { return static_cast<int>(m_threads.size()); }
+
+    void run(Group &group, std::function<void()> task);
+    void wait(Group &group);
+
+    // Totals since construction
+    std::uint64_t tasksRun() const { return m_tasksRun.load(std::memory_order_relaxed); }
+    std::uint64_t steals() const { return m_steals.load(std::memory_order_relaxed); }
+    // Time spent running tasks, summed over threads; time a task spends
+    // blocked in wait() is not counted
+    double busySeconds() const { return m_busyNs.load(std::memory_order_relaxed) * 1e-9; }
+
+private:
+    struct Task {
+        std::function<void()> function;
+        Group *group = nullptr;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // One queue per worker, plus the shared queue for outside threads (last)
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    // Workers sleep on m_wake while nothing is queued, waiters on
+    // m_groupDone while the rest of their group runs elsewhere
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_groupDone;
+    std::atomic<int> m_queued{0};
+    bool m_stopping = false;
+
+    std::atomic<std::uint64_t> m_tasksRun{0};
+    std::atomic<std::uint64_t> m_steals{0};
+    std::atomic<std::int64_t> m_busyNs{0};
+
+    int queueIndex() const;
+    bool takeTask(int self, const Group *only, Task &task);
+    void execute(Task &task);
+    void workerLoop(int index);
+};
+
+#endif // TASKPOOL_H
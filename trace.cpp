@@ -0,0 +1,115 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+
+std::atomic<bool> g_tracingEnabled{false};
+
+// Published with release and read with acquire: spans test
+// g_tracingEnabled with a relaxed load, which orders nothing, so a thread
+// can see tracing on before it sees the buffer
+static std::atomic<TraceEvent*> s_ring{nullptr};
+static std::once_flag s_ringOnce;
+static std::atomic<std::uint64_t> s_next{0};
+static std::atomic<std::uint32_t> s_threadCount{0};
+
+void setTracingEnabled(bool enabled) {
+    // The buffer is only allocated the first time tracing is turned on and
+    // is never freed, so spans still in flight can always write to it
+    if (enabled) {
+        std::call_once(s_ringOnce, [] { s_ring.store(new TraceEvent[kTraceCapacity], std::memory_order_release); });
+    }
+    g_tracingEnabled.store(enabled, std::memory_order_release);
+}
+
+std::int64_t traceNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::uint32_t threadNumber() {
+    thread_local std::uint32_t number = s_threadCount.fetch_add(1, std::memory_order_relaxed);
+    return number;
+}
+
+void recordSpan(const char *name, std::int64_t startNs, std::int64_t endNs) {
+    TraceEvent *ring = s_ring.load(std::memory_order_acquire);
+    if (!ring) {
+        return;
+    }
+    std::uint64_t slot = s_next.fetch_add(1, std::memory_order_relaxed) % kTraceCapacity;
+    TraceEvent &event = ring[slot];
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = endNs - startNs;
+    event.thread = threadNumber();
+}
+
+std::vector<TraceEvent> traceEvents() {
+    std::vector<TraceEvent> events;
+    const TraceEvent *ring = s_ring.load(std::memory_order_acquire);
+    if (!ring) {
+        return events;
+    }
+    std::uint64_t next = s_next.load(std::memory_order_acquire);
+    std::uint64_t count = std::min<std::uint64_t>(next, kTraceCapacity);
+    events.reserve(count);
+    for (std::uint64_t i = next - count; i < next; i++) {
+        events.push_back(ring[i % kTraceCapacity]);
+    }
+    return events;
+}
+
+std::vector<TraceStats> traceSummary() {
+    // Keyed by content: the same literal used in two files need not share
+    // an address
+    std::map<std::string, TraceStats> byName;
+    for (const TraceEvent &event : traceEvents()) {
+        TraceStats &stats = byName.try_emplace(event.name, TraceStats{event.name, 0, 0.0, 0.0, 0.0}).first->second;
+        double ms = event.durationNs / 1e6;
+        stats.count++;
+        stats.totalMs += ms;
+        stats.maxMs = std::max(stats.maxMs, ms);
+    }
+
+    std::vector<TraceStats> summary;
+    for (auto &[name, stats] : byName) {
+        stats.meanMs = stats.totalMs / stats.count;
+        summary.push_back(stats);
+    }
+    std::sort(summary.begin(), summary.end(), [](const TraceStats &a, const TraceStats &b) {
+        return a.totalMs > b.totalMs;
+    });
+    return summary;
+}
+
+void clearTrace() {
+    s_next.store(0, std::memory_order_release);
+}
+
+bool exportChromeTrace(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    std::vector<TraceEvent> events = traceEvents();
+    std::int64_t origin = events.empty() ? 0 : events.front().startNs;
+    for (const TraceEvent &event : events) {
+        origin = std::min(origin, event.startNs);
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceEvent &event = events[i];
+        out << (i ? ",\n" : "\n")
+            << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << (event.startNs - origin) / 1000.0
+            << ",\"dur\":" << event.durationNs / 1000.0 << "}";
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,88 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Hot-path tracing. TRACE_SPAN("name") times the rest of the enclosing scope
+ * and records it into a fixed-size ring buffer shared by all threads; once
+ * the buffer is full the oldest spans are overwritten. While tracing is
+ * disabled a span costs one relaxed atomic load, and building with
+ * RASTER_TRACING=0 compiles the spans out entirely.
+ *
+ * Span names must be string literals, since only the pointer is stored.
+ */
+
+#ifndef RASTER_TRACING
+#define RASTER_TRACING 1
+#endif
+
+struct TraceEvent {
+    const char *name = nullptr;
+    std::int64_t startNs = 0;
+    std::int64_t durationNs = 0;
+    std::uint32_t thread = 0;   // small per-thread number, 0 for the first thread seen
+};
+
+struct TraceStats {
+    const char *name;
+    int count;
+    double totalMs;
+    double meanMs;
+    double maxMs;
+};
+
+// Number of spans kept before the oldest are overwritten
+constexpr int kTraceCapacity = 1 << 16;
+
+extern std::atomic<bool> g_tracingEnabled;
+
+inline bool tracingEnabled() {
+    return g_tracingEnabled.load(std::memory_order_relaxed);
+}
+
+void setTracingEnabled(bool enabled);
+std::int64_t traceNowNs();
+void recordSpan(const char *name, std::int64_t startNs, std::int64_t endNs);
+
+// The functions below read the ring buffer; call them while no traced work
+// is running, or expect the newest spans to be partially written.
+
+// Recorded spans, oldest first
+std::vector<TraceEvent> traceEvents();
+// Per-name totals, largest total time first
+std::vector<TraceStats> traceSummary();
+void clearTrace();
+// Writes the spans in Chrome trace format (chrome://tracing, Perfetto)
+bool exportChromeTrace(const std::string &path);
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name)
+        : m_name(name), m_startNs(tracingEnabled() ? traceNowNs() : -1) {}
+    ~TraceSpan() {
+        if (m_startNs >= 0) {
+            recordSpan(m_name, m_startNs, traceNowNs());
+        }
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *m_name;
+    std::int64_t m_startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if RASTER_TRACING
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) ((void)0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,289 @@
+#include "workimage.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WORKIMAGE_SSE2 1
+#endif
+
+static_assert(sizeof(RGBA) == 4, "RGBA must be tightly packed");
+
+/**
+ * @brief Takes ownership of an interleaved RGBA buffer.
+ * @param data: pixels to adopt, left holding the previous interleaved storage
+ */
+void WorkImage::adopt(std::vector<RGBA> &data, int w, int h) {
+    width = w;
+    height = h;
+    layout = ImageLayout::Interleaved;
+    pixels.swap(data);
+}
+
+/**
+ * @brief Converts back to interleaved and swaps the pixels into data.
+ */
+void WorkImage::release(std::vector<RGBA> &data) {
+    convertTo(ImageLayout::Interleaved);
+    data.swap(pixels);
+}
+
+/**
+ * @brief Sizes the storage of the target layout for the current image size
+ */
+void WorkImage::reserve(ImageLayout target) {
+    size_t n = size();
+    if (target == ImageLayout::Interleaved) {
+        pixels.resize(n);
+    } else {
+        for (int c = 0; c < 4; c++) {
+            planes8[c].resize(n);
+        }
+        if (target == ImageLayout::PlanarFloat) {
+            for (int c = 0; c < 3; c++) {
+                planesF[c].resize(n);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Converts the image to the target layout. Does nothing if the image
+ * already is in that layout and no point ops are pending.
+ */
+void WorkImage::convertTo(ImageLayout target) {
+    if (!pendingOps.isIdentity()) {
+        convertMapped(target);
+        return;
+    }
+    if (target == layout) {
+        return;
+    }
+    TRACE_SPAN("convertLayout");
+    size_t n = size();
+    reserve(target);
+
+    if (layout == ImageLayout::Interleaved && target == ImageLayout::Planar8) {
+        deinterleave(pixels.data(), n, planes8[0].data(), planes8[1].data(), planes8[2].data(), planes8[3].data());
+    } else if (layout == ImageLayout::Interleaved && target == ImageLayout::PlanarFloat) {
+        interleavedToFloat(pixels.data(), n, planesF[0].data(), planesF[1].data(), planesF[2].data(), planes8[3].data());
+    } else if (layout == ImageLayout::Planar8 && target == ImageLayout::Interleaved) {
+        interleave(planes8[0].data(), planes8[1].data(), planes8[2].data(), planes8[3].data(), n, pixels.data());
+    } else if (layout == ImageLayout::Planar8 && target == ImageLayout::PlanarFloat) {
+        for (int c = 0; c < 3; c++) {
+            widenToFloat(planes8[c].data(), n, planesF[c].data());
+        }
+    } else if (layout == ImageLayout::PlanarFloat && target == ImageLayout::Interleaved) {
+        floatToInterleaved(planesF[0].data(), planesF[1].data(), planesF[2].data(), planes8[3].data(), n, pixels.data());
+    } else if (layout == ImageLayout::PlanarFloat && target == ImageLayout::Planar8) {
+        for (int c = 0; c < 3; c++) {
+            narrowToByte(planesF[c].data(), n, planes8[c].data());
+        }
+    }
+    layout = target;
+}
+
+/**
+ * @brief convertTo() with pending point ops, in blocks small enough for L1:
+ * each block is brought to 8-bit planes, mapped and written to the target
+ * layout before the next one is read. Float planes are truncated to 8 bits
+ * on the way, as they would be by any conversion to an 8-bit layout.
+ */
+void WorkImage::convertMapped(ImageLayout target) {
+    TRACE_SPAN("convertLayout.mapped");
+    constexpr size_t kBlock = 1024;
+    size_t n = size();
+    reserve(target);
+
+    alignas(16) std::uint8_t block[4][kBlock];
+    for (size_t i = 0; i < n; i += kBlock) {
+        size_t count = std::min(kBlock, n - i);
+        const std::uint8_t *in[3] = {block[0], block[1], block[2]};
+        const std::uint8_t *alpha = block[3];
+        if (layout == ImageLayout::Interleaved) {
+            deinterleave(pixels.data() + i, count, block[0], block[1], block[2], block[3]);
+        } else {
+            for (int c = 0; c < 3; c++) {
+                if (layout == ImageLayout::Planar8) {
+                    in[c] = planes8[c].data() + i;
+                } else {
+                    narrowToByte(planesF[c].data() + i, count, block[c]);
+                }
+            }
+            alpha = planes8[3].data() + i;
+        }
+
+        if (target == ImageLayout::Planar8) {
+            pendingOps.apply(in[0], in[1], in[2], count, planes8[0].data() + i, planes8[1].data() + i, planes8[2].data() + i);
+            if (alpha == block[3]) {
+                std::copy(alpha, alpha + count, planes8[3].data() + i);
+            }
+            continue;
+        }
+        pendingOps.apply(in[0], in[1], in[2], count, block[0], block[1], block[2]);
+        if (target == ImageLayout::Interleaved) {
+            interleave(block[0], block[1], block[2], alpha, count, pixels.data() + i);
+        } else {
+            for (int c = 0; c < 3; c++) {
+                widenToFloat(block[c], count, planesF[c].data() + i);
+            }
+            if (alpha == block[3]) {
+                std::copy(alpha, alpha + count, planes8[3].data() + i);
+            }
+        }
+    }
+    pendingOps = PointOp();
+    layout = target;
+}
+
+static inline std::uint8_t clampToByte(float v) {
+    return static_cast<std::uint8_t>(std::max(0.0f, std::min(255.0f, v)));
+}
+
+#ifdef WORKIMAGE_SSE2
+// Packs the low byte of each 32-bit lane of four vectors into 16 bytes
+static inline __m128i packLowBytes(__m128i v0, __m128i v1, __m128i v2, __m128i v3) {
+    return _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3));
+}
+
+// Clamps four floats to [0, 255] and truncates them to int32
+static inline __m128i clampTruncate(__m128 v) {
+    v = _mm_max_ps(_mm_setzero_ps(), _mm_min_ps(_mm_set1_ps(255.0f), v));
+    return _mm_cvttps_epi32(v);
+}
+#endif
+
+void deinterleave(const RGBA *src, size_t count, std::uint8_t *r, std::uint8_t *g, std::uint8_t *b, std::uint8_t *a) {
+    size_t i = 0;
+#ifdef WORKIMAGE_SSE2
+    const __m128i lowByte = _mm_set1_epi32(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        __m128i px[4];
+        for (int k = 0; k < 4; k++) {
+            px[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4 * k));
+        }
+        __m128i ch[4][4];
+        for (int k = 0; k < 4; k++) {
+            ch[0][k] = _mm_and_si128(px[k], lowByte);
+            ch[1][k] = _mm_and_si128(_mm_srli_epi32(px[k], 8), lowByte);
+            ch[2][k] = _mm_and_si128(_mm_srli_epi32(px[k], 16), lowByte);
+            ch[3][k] = _mm_srli_epi32(px[k], 24);
+        }
+        std::uint8_t *out[4] = {r, g, b, a};
+        for (int c = 0; c < 4; c++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out[c] + i), packLowBytes(ch[c][0], ch[c][1], ch[c][2], ch[c][3]));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        r[i] = src[i].r;
+        g[i] = src[i].g;
+        b[i] = src[i].b;
+        a[i] = src[i].a;
+    }
+}
+
+void interleave(const std::uint8_t *r, const std::uint8_t *g, const std::uint8_t *b, const std::uint8_t *a, size_t count, RGBA *dst) {
+    size_t i = 0;
+#ifdef WORKIMAGE_SSE2
+    for (; i + 16 <= count; i += 16) {
+        __m128i vr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+        __m128i vg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i rgLo = _mm_unpacklo_epi8(vr, vg);
+        __m128i rgHi = _mm_unpackhi_epi8(vr, vg);
+        __m128i baLo = _mm_unpacklo_epi8(vb, va);
+        __m128i baHi = _mm_unpackhi_epi8(vb, va);
+        __m128i *out = reinterpret_cast<__m128i*>(dst + i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = RGBA{r[i], g[i], b[i], a[i]};
+    }
+}
+
+void widenToFloat(const std::uint8_t *src, size_t count, float *dst) {
+    size_t i = 0;
+#ifdef WORKIMAGE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(dst + i,      _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_ps(dst + i + 4,  _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_ps(dst + i + 8,  _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_ps(dst + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = src[i];
+    }
+}
+
+void narrowToByte(const float *src, size_t count, std::uint8_t *dst) {
+    size_t i = 0;
+#ifdef WORKIMAGE_SSE2
+    for (; i + 16 <= count; i += 16) {
+        __m128i v0 = clampTruncate(_mm_loadu_ps(src + i));
+        __m128i v1 = clampTruncate(_mm_loadu_ps(src + i + 4));
+        __m128i v2 = clampTruncate(_mm_loadu_ps(src + i + 8));
+        __m128i v3 = clampTruncate(_mm_loadu_ps(src + i + 12));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packLowBytes(v0, v1, v2, v3));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = clampToByte(src[i]);
+    }
+}
+
+void interleavedToFloat(const RGBA *src, size_t count, float *r, float *g, float *b, std::uint8_t *a) {
+    size_t i = 0;
+#ifdef WORKIMAGE_SSE2
+    const __m128i lowByte = _mm_set1_epi32(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        __m128i alpha[4];
+        for (int k = 0; k < 4; k++) {
+            size_t j = i + 4 * k;
+            __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+            _mm_storeu_ps(r + j, _mm_cvtepi32_ps(_mm_and_si128(px, lowByte)));
+            _mm_storeu_ps(g + j, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), lowByte)));
+            _mm_storeu_ps(b + j, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), lowByte)));
+            alpha[k] = _mm_srli_epi32(px, 24);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a + i), packLowBytes(alpha[0], alpha[1], alpha[2], alpha[3]));
+    }
+#endif
+    for (; i < count; i++) {
+        r[i] = src[i].r;
+        g[i] = src[i].g;
+        b[i] = src[i].b;
+        a[i] = src[i].a;
+    }
+}
+
+void floatToInterleaved(const float *r, const float *g, const float *b, const std::uint8_t *a, size_t count, RGBA *dst) {
+    size_t i = 0;
+#ifdef WORKIMAGE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        std::uint32_t alpha4;
+        std::memcpy(&alpha4, a + i, sizeof(alpha4));
+        __m128i va = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(alpha4), zero), zero);
+        __m128i px = clampTruncate(_mm_loadu_ps(r + i));
+        px = _mm_or_si128(px, _mm_slli_epi32(clampTruncate(_mm_loadu_ps(g + i)), 8));
+        px = _mm_or_si128(px, _mm_slli_epi32(clampTruncate(_mm_loadu_ps(b + i)), 16));
+        px = _mm_or_si128(px, _mm_slli_epi32(va, 24));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), px);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = RGBA{clampToByte(r[i]), clampToByte(g[i]), clampToByte(b[i]), a[i]};
+    }
+}
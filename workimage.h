@@ -0,0 +1,72 @@
+#ifndef WORKIMAGE_H
+#define WORKIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "pointops.h"
+#include "rgba.h"
+#include "scratcharena.h"
+
+// Memory layouts an image can be processed in. Filters declare the layout
+// they want (see imagefilters.h) and the image is converted once on entry.
+enum class ImageLayout {
+    Interleaved,    // one RGBA struct per pixel, as stored by Canvas2D
+    Planar8,        // separate uint8 planes for r, g, b and a
+    PlanarFloat     // separate float planes for r, g, b; alpha stays uint8
+};
+
+/**
+ * @struct WorkImage
+ *
+ * Image buffer used by the filter code. Only the storage belonging to the
+ * current layout is valid:
+ *  - Interleaved: `pixels`
+ *  - Planar8:     `planes8[0..3]` (r, g, b, a)
+ *  - PlanarFloat: `planesF[0..2]` (r, g, b) and `planes8[3]` (a)
+ * Storage for other layouts is kept around so converting back and forth
+ * does not reallocate, and so are the filters' temporary planes (`scratch`).
+ *
+ * Point operations are not applied when they are requested (applyPointOp()
+ * in imagefilters.h) but collected in `pendingOps` and applied block by
+ * block inside the next convertTo(), while each block is in cache anyway.
+ * Filters convert on entry and release() converts on exit, so a point op
+ * between two filters costs no pass of its own unless both use the same
+ * layout, in which case convertTo() applies it in place.
+ */
+struct WorkImage {
+    int width = 0;
+    int height = 0;
+    ImageLayout layout = ImageLayout::Interleaved;
+
+    std::vector<RGBA> pixels;
+    std::vector<std::uint8_t> planes8[4];
+    std::vector<float> planesF[3];
+    ScratchArena scratch;
+    PointOp pendingOps;
+
+    size_t size() const { return static_cast<size_t>(width) * height; }
+
+    // Takes ownership of interleaved pixels without copying
+    void adopt(std::vector<RGBA> &data, int w, int h);
+    // Converts to interleaved and hands the pixels back without copying
+    void release(std::vector<RGBA> &data);
+
+    // Converts to `target` and applies pendingOps
+    void convertTo(ImageLayout target);
+
+private:
+    void reserve(ImageLayout target);
+    void convertMapped(ImageLayout target);
+};
+
+// Conversion kernels, SSE2 where available. Float to uint8 conversions clamp
+// to [0, 255] and truncate, like the original filter code did.
+void deinterleave(const RGBA *src, size_t count, std::uint8_t *r, std::uint8_t *g, std::uint8_t *b, std::uint8_t *a);
+void interleave(const std::uint8_t *r, const std::uint8_t *g, const std::uint8_t *b, const std::uint8_t *a, size_t count, RGBA *dst);
+void widenToFloat(const std::uint8_t *src, size_t count, float *dst);
+void narrowToByte(const float *src, size_t count, std::uint8_t *dst);
+void interleavedToFloat(const RGBA *src, size_t count, float *r, float *g, float *b, std::uint8_t *a);
+void floatToInterleaved(const float *r, const float *g, const float *b, const std::uint8_t *a, size_t count, RGBA *dst);
+
+#endif // WORKIMAGE_H